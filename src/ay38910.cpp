@@ -20,9 +20,125 @@ along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
 #include <cstdio>
 #include <cmath>
 #include <array>
+#include <iterator>
+#include <initializer_list>
 #include "ay38910.h"
 
-void AY38910::Step(uint8_t bus, uint8_t bc1, uint8_t bc2, uint8_t bdir)
+constexpr int16_t AY38910::amplitude_table[16];
+
+namespace {
+
+struct psg_tables_t
+{
+    // the level at each step of the 16 envelope shapes
+    uint8_t envelope[16][64];
+    // the output of the noise LFSR after each tick, one bit per tick
+    uint32_t noise[(AY38910::NOISE_PERIOD + 31) / 32];
+
+    psg_tables_t()
+    {
+        // from the datasheet, the shape bits are continue, attack, alternate and hold
+        for (int shape = 0; shape < 16; shape++)
+        {
+            const bool cont = (shape & 8) != 0, attack = (shape & 4) != 0;
+            const bool alternate = (shape & 2) != 0, hold = (shape & 1) != 0;
+            for (int ramp = 0; ramp < 4; ramp++)
+            {
+                for (int step = 0; step < 16; step++)
+                {
+                    uint8_t level;
+                    if (ramp == 0)
+                        level = (uint8_t) (attack ? step : 15 - step);
+                    else if (!cont)
+                        level = 0;
+                    else if (hold)
+                        level = (uint8_t) ((attack != alternate) ? 15 : 0);
+                    else
+                        level = (uint8_t) ((attack != (alternate && (ramp & 1))) ? step : 15 - step);
+                    envelope[shape][ramp * 16 + step] = level;
+                }
+            }
+        }
+
+        uint32_t rng = 1;
+        std::fill(std::begin(noise), std::end(noise), 0);
+        for (uint32_t i = 0; i < AY38910::NOISE_PERIOD; i++)
+        {
+            noise[i / 32] |= (rng & 1) << (i % 32);
+            rng ^= (((rng & 1) ^ ((rng >> 3) & 1)) << 17);
+            rng >>= 1;
+        }
+    }
+};
+
+const psg_tables_t tables;
+
+}
+
+uint8_t AY38910::noise_t::output() const
+{
+    return (uint8_t) ((tables.noise[index_ / 32] >> (index_ % 32)) & 1);
+}
+
+uint8_t AY38910::envelope_t::output() const
+{
+    return tables.envelope[shape_][position_];
+}
+
+// the most samples that are rendered at once
+static const size_t MAX_SAMPLES = 4096;
+
+// the most the rate adjustment changes in a frame
+static const double MAX_ADJUST_STEP = 0.0005;
+
+AY38910::AY38910() : output_(MAX_SAMPLES), samples_(MAX_SAMPLES)
+{
+    output_.SetRates(CLOCK, sample_rate_);
+}
+
+void AY38910::SetSampleRate(double rate)
+{
+    sample_rate_ = rate;
+    output_.SetRates(CLOCK, sample_rate_ * rate_adjust_);
+    for (auto &stem : stems_)
+        stem.SetRates(CLOCK, sample_rate_ * rate_adjust_);
+}
+
+void AY38910::EnableStems(bool enabled)
+{
+    if (enabled == StemsEnabled())
+        return;
+
+    stems_.clear();
+    if (!enabled)
+        return;
+
+    // the mixed output is cleared as well so that the stems start in step with it, at the current levels
+    output_.Clear();
+    stems_.assign(STEM_COUNT, output_);
+    channel_a.stem_ = channel_a.stem(STEM_A);
+    channel_b.stem_ = channel_b.stem(STEM_B);
+    channel_c.stem_ = channel_c.stem(STEM_C);
+    for (auto *channel : { &channel_a, &channel_b, &channel_c })
+    {
+        output_.AddDelta(time_, channel->level_);
+        stems_[channel->stem_].AddDelta(time_, channel->level_);
+    }
+    output_.AddDelta(time_, dac_level_);
+    stems_[STEM_DAC].AddDelta(time_, dac_level_);
+}
+
+bool AY38910::StemsEnabled() const
+{
+    return !stems_.empty();
+}
+
+void AY38910::SetRateAdjust(double adjust)
+{
+    target_adjust_ = adjust;
+}
+
+void AY38910::Step(uint8_t bus, uint8_t bc1, uint8_t bc2, uint8_t bdir, uint64_t cycle)
 {
     switch(bdir << 2 | bc2 << 1 | bc1)
     {
@@ -37,7 +153,7 @@ void AY38910::Step(uint8_t bus, uint8_t bc1, uint8_t bc2, uint8_t bdir)
             addr = (uint8_t)(bus & 0xf);
             break;
         case PSG_DWS:
-            Write(addr, bus);
+            Write(addr, bus, cycle);
             break;
         case PSG_DTS:
             // read callback
@@ -56,9 +172,18 @@ void AY38910::Step(uint8_t bus, uint8_t bc1, uint8_t bc2, uint8_t bdir)
     }
 }
 
+void AY38910::Write(uint8_t reg, uint8_t value, uint64_t cycle)
+{
+    Run(ClockTime(cycle));
+    Write(reg, value);
+}
+
 void AY38910::Write(uint8_t reg, uint8_t value)
 {
     regs[reg] = value;
+    const auto t = time_;
+    // a new period carries on from where the counter is, so the skipped ticks have to be caught up first
+    SkipInactive(t);
 
     switch(reg)
     {
@@ -67,21 +192,21 @@ void AY38910::Write(uint8_t reg, uint8_t value)
         // the maximum value for period is 4095 and the minimum value is 1
         case PSG_REG_A_FINE:
         case PSG_REG_A_COARSE:
-            channel_a.setPeriod((uint8_t) (regs[PSG_REG_A_COARSE] & 0xf), regs[PSG_REG_A_FINE]);
+            channel_a.setPeriod(t, channel_t::DIVIDER, (uint8_t) (regs[PSG_REG_A_COARSE] & 0xf), regs[PSG_REG_A_FINE]);
             break;
 
         case PSG_REG_B_FINE: // same as period A
         case PSG_REG_B_COARSE:
-            channel_b.setPeriod((uint8_t) (regs[PSG_REG_B_COARSE] & 0xf), regs[PSG_REG_B_FINE]);
+            channel_b.setPeriod(t, channel_t::DIVIDER, (uint8_t) (regs[PSG_REG_B_COARSE] & 0xf), regs[PSG_REG_B_FINE]);
             break;
 
         case PSG_REG_C_FINE: // same as period A/B
         case PSG_REG_C_COARSE:
-            channel_c.setPeriod((uint8_t) (regs[PSG_REG_C_COARSE] & 0xf), regs[PSG_REG_C_FINE]);
+            channel_c.setPeriod(t, channel_t::DIVIDER, (uint8_t) (regs[PSG_REG_C_COARSE] & 0xf), regs[PSG_REG_C_FINE]);
             break;
 
         case PSG_REG_NOISE:
-            channel_noise.setPeriod((uint8_t) (regs[PSG_REG_NOISE] & 0x1f));
+            channel_noise.setPeriod(t, noise_t::DIVIDER, 0, (uint8_t) (regs[PSG_REG_NOISE] & 0x1f));
             break;
 
         case PSG_REG_MIXER_CTRL:
@@ -109,15 +234,19 @@ void AY38910::Write(uint8_t reg, uint8_t value)
 
         case PSG_REG_ENV_FINE:
         case PSG_REG_ENV_COARSE:
-            envelope.setPeriod(regs[PSG_REG_ENV_COARSE], regs[PSG_REG_ENV_FINE]);
+            envelope.setPeriod(t, envelope_t::DIVIDER, regs[PSG_REG_ENV_COARSE], regs[PSG_REG_ENV_FINE]);
             break;
         case PSG_REG_ENV_CTRL:
             // control the shape of the envelope
-            envelope.setControl((uint8_t) (value & 0xf));
+            envelope.setControl(t, (uint8_t) (value & 0xf));
             break;
 
         default:break;
     }
+
+    // the mixer and amplitudes change the output straight away
+    UpdateActive(t);
+    UpdateLevels(t);
 }
 
 void AY38910::SetIOReadCallback(AY38910::read_io_callback func, intptr_t ref)
@@ -132,22 +261,181 @@ void AY38910::SetRegStoreCallback(AY38910::store_reg_callback func, intptr_t ref
     store_reg_ref = ref;
 }
 
-void AY38910::FillBuffer(uint8_t *buffer, size_t length)
+void AY38910::UpdateLevels(uint32_t time)
+{
+    const auto noise = channel_noise.output();
+    const auto envelope_amplitude = envelope.output();
+
+    auto update = [&](channel_t &channel, bool on, uint8_t stem) {
+        const int16_t level = on ? channel.level(noise, envelope_amplitude) : (int16_t) 0;
+        if (level != channel.level_)
+            output_.AddDelta(time, level - channel.level_);
+
+        if (!stems_.empty())
+        {
+            stem = channel.stem(stem);
+            if (stem != channel.stem_)
+            {
+                // the level moves from one stem to the other
+                stems_[channel.stem_].AddDelta(time, -channel.level_);
+                stems_[stem].AddDelta(time, level);
+            }
+            else if (level != channel.level_)
+            {
+                stems_[stem].AddDelta(time, level - channel.level_);
+            }
+            channel.stem_ = stem;
+        }
+        channel.level_ = level;
+    };
+    update(channel_a, channel_a_on, STEM_A);
+    update(channel_b, channel_b_on, STEM_B);
+    update(channel_c, channel_c_on, STEM_C);
+}
+
+void AY38910::UpdateActive(uint32_t time)
+{
+    const bool a = channel_a.audible(channel_a_on);
+    const bool b = channel_b.audible(channel_b_on);
+    const bool c = channel_c.audible(channel_c_on);
+
+    // a generator that becomes active is caught up with the ticks it skipped
+    auto activate = [time](auto &generator, bool active) {
+        if (active && !generator.active_)
+            generator.advance(generator.skip(time));
+        generator.active_ = active;
+    };
+    activate(channel_a, a && channel_a.enabled);
+    activate(channel_b, b && channel_b.enabled);
+    activate(channel_c, c && channel_c.enabled);
+    activate(channel_noise, (a && channel_a.noise_enabled) || (b && channel_b.noise_enabled) ||
+                            (c && channel_c.noise_enabled));
+    activate(envelope, (a && channel_a.amplitude_mode) || (b && channel_b.amplitude_mode) ||
+                       (c && channel_c.amplitude_mode));
+}
+
+void AY38910::SkipInactive(uint32_t time)
+{
+    auto skip = [time](auto &generator) {
+        if (!generator.active_)
+            generator.advance(generator.skip(time));
+    };
+    skip(channel_a);
+    skip(channel_b);
+    skip(channel_c);
+    skip(channel_noise);
+    skip(envelope);
+}
+
+void AY38910::Run(uint32_t end)
+{
+    // the channels might have been muted since the last run
+    UpdateActive(time_);
+    UpdateLevels(time_);
+
+    auto next = [](const periodic_t &generator) {
+        return generator.active_ ? generator.next_ : UINT32_MAX;
+    };
+
+    for (;;)
+    {
+        const uint32_t t = std::min({ next(channel_a), next(channel_b), next(channel_c),
+                                      next(channel_noise), next(envelope) });
+        if (t >= end)
+            break;
+
+        if (next(channel_a) == t)
+            channel_a.tick();
+        if (next(channel_b) == t)
+            channel_b.tick();
+        if (next(channel_c) == t)
+            channel_c.tick();
+        if (next(channel_noise) == t)
+            channel_noise.tick();
+        if (next(envelope) == t)
+            envelope.tick();
+
+        UpdateLevels(t);
+    }
+    time_ = end;
+}
+
+void AY38910::WriteDAC(int8_t value, uint64_t cycle)
 {
-    int16_t ampl_a = 0, ampl_b = 0, ampl_c = 0;
-    memset(buffer, 0, length);
+    const auto level = (int16_t) (value * DAC_SCALE);
+    if (level == dac_level_)
+        return;
+
+    // the DAC does not change the state of the generators, so there is no need to run them up to the cycle
+    const auto time = ClockTime(cycle);
+    output_.AddDelta(time, level - dac_level_);
+    if (!stems_.empty())
+        stems_[STEM_DAC].AddDelta(time, level - dac_level_);
+    dac_level_ = level;
+}
 
-    for (int i = 0; i < length; i++)
+uint32_t AY38910::ClockTime(uint64_t cycle)
+{
+    // if the samples are not being read, drop them rather than letting the frame grow without end
+    if (cycle - frame_cycle_ > output_.ClocksNeeded(MAX_SAMPLES))
     {
-        auto noise = channel_noise.step();
-        auto envelope_counter = envelope.step();
+        EndFrame(cycle);
+        while (output_.ReadSamples(samples_.data(), samples_.size()))
+            ;
+        for (auto &stem : stems_)
+            while (stem.ReadSamples(samples_.data(), samples_.size()))
+                ;
+    }
+    return (uint32_t) (cycle - frame_cycle_);
+}
 
-        ampl_a = channel_a.step(noise, envelope_counter);
-        ampl_b = channel_b.step(noise, envelope_counter);
-        ampl_c = channel_c.step(noise, envelope_counter);
+void AY38910::EndFrame(uint64_t cycle)
+{
+    const auto clocks = (uint32_t) std::min<uint64_t>(cycle - frame_cycle_, output_.ClocksNeeded(MAX_SAMPLES));
+    Run(clocks);
+    output_.EndFrame(clocks);
+    for (auto &stem : stems_)
+        stem.EndFrame(clocks);
+    frame_cycle_ = cycle;
 
-        *(buffer++) = (uint8_t)((uint16_t)(((channel_a_on ? ampl_a : 0) +
-                                            (channel_b_on ? ampl_b : 0) +
-                                            (channel_c_on ? ampl_c : 0)) / 3.0) >> 8);
+    // the rate can change between frames without a discontinuity, the fraction of a sample carries over
+    if (rate_adjust_ != target_adjust_)
+    {
+        rate_adjust_ += std::min(std::max(target_adjust_ - rate_adjust_, -MAX_ADJUST_STEP), MAX_ADJUST_STEP);
+        output_.SetRates(CLOCK, sample_rate_ * rate_adjust_);
+        for (auto &stem : stems_)
+            stem.SetRates(CLOCK, sample_rate_ * rate_adjust_);
     }
+
+    // make the times relative to the start of the next frame, the inactive generators are skipped up to the end of
+    // this one first
+    SkipInactive(clocks);
+    channel_a.next_ -= clocks;
+    channel_b.next_ -= clocks;
+    channel_c.next_ -= clocks;
+    channel_noise.next_ -= clocks;
+    envelope.next_ -= clocks;
+    time_ -= clocks;
+}
+
+size_t AY38910::SamplesAvailable() const
+{
+    return output_.SamplesAvailable();
+}
+
+size_t AY38910::FillBuffer(int16_t *buffer, size_t frames)
+{
+    // mono, the left samples are read straight in to the buffer and copied to the right
+    const auto count = output_.ReadSamples(buffer, frames, 2);
+    for (size_t i = 0; i < count; i++)
+        buffer[i * 2 + 1] = buffer[i * 2];
+    return count;
+}
+
+size_t AY38910::FillStems(int16_t *buffer, size_t frames)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < stems_.size(); i++)
+        count = stems_[i].ReadSamples(buffer + i, frames, STEM_COUNT);
+    return count;
 }
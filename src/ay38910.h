@@ -22,6 +22,8 @@ along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
 #include <cstdint>
 #include <cmath>
 #include <algorithm>
+#include <vector>
+#include "blip.h"
 
 const double pi = std::acos(-1);
 
@@ -55,193 +57,268 @@ enum {
     PSG_REG_PORTB      = 017
 };
 
+/*
+ * AY-3-8910 programmable sound generator
+ *
+ * The tone, noise and envelope generators are run from one change to the next rather than for every clock or
+ * sample: each generator keeps the clock time of its next tick, and the level of each channel is only worked out
+ * when one of them ticks or a register is written. Changes in the level are added to a band-limited buffer, so
+ * the output does not alias however high the tone. Generators that cannot change the output (a tone that is
+ * disabled in the mixer, noise or an envelope that no audible channel uses) are not ticked at all, they are
+ * skipped ahead when they are needed again, the envelope shapes and noise sequence are tables for that.
+ *
+ * Register writes are stamped with the CPU cycle they happen at (the PSG runs from the same 1.5MHz clock), the
+ * generators are run up to that cycle with the old state before the write is applied. So a change part way
+ * through a frame is heard at the right sample, and the only work between writes is the ticks in between.
+ * Times are in PSG clocks since the end of the last frame.
+ */
 class AY38910
 {
     using read_io_callback = uint8_t (*)(intptr_t);
     using store_reg_callback = void (*)(intptr_t, uint8_t);
 
-    template <int sample_rate>
+public:
+    // the PSG is clocked at 1.5MHz
+    static const uint32_t CLOCK = 1500000;
+    // the 17 bit noise LFSR repeats after NOISE_PERIOD ticks, the sequence is stored as a table of bits so that the
+    // noise can skip ahead
+    static const uint32_t NOISE_PERIOD = (1 << 17) - 1;
+
+    static constexpr int16_t amplitude_table[16] = { 0x0000, 0x0055, 0x0079, 0x00AB, 0x00F1, 0x0155, 0x01E3, 0x02AA,
+                                                     0x03C5, 0x0555, 0x078B, 0x0AAB, 0x0F16, 0x1555, 0x1E2B, 0x2AAA };
+
+private:
     struct periodic_t
     {
         uint16_t period_ = 1;
-        double frequency_;
-        double velocity_ = 0.0;
-
-        const int16_t amplitude_table[16] = { 0x0000, 0x0055, 0x0079, 0x00AB, 0x00F1, 0x0155, 0x01E3, 0x02AA,
-                                              0x03C5, 0x0555, 0x078B, 0x0AAB, 0x0F16, 0x1555, 0x1E2B, 0x2AAA };
-
-        double setPeriod(uint8_t coarse, uint8_t fine)
+        // clocks between ticks, and the time of the next tick
+        uint32_t interval_ = 1;
+        uint32_t next_ = 0;
+        // the ticks are only run while they can change the output, otherwise they are skipped and caught up later
+        bool active_ = true;
+
+        // the counters tick every divider * period clocks
+        void setPeriod(uint32_t time, uint32_t divider, uint8_t coarse, uint8_t fine)
         {
             period_ = std::max<uint16_t>((uint16_t) ((coarse << 8) | fine), 1);
-            frequency_ = 1.5e6/(period_ * 16);
-            velocity_ = (frequency_ / (double)sample_rate) * 4.0;
-            return frequency_;
+
+            // the counter carries on from where it is, if it has already passed the new period it ticks now
+            const uint32_t elapsed = interval_ - std::min(next_ - time, interval_);
+            interval_ = divider * period_;
+            next_ = time + (elapsed < interval_ ? interval_ - elapsed : 0);
         }
-        double setPeriod(uint8_t fine)
+
+        // Skip the ticks before time, returns the number skipped
+        inline uint32_t skip(uint32_t time)
         {
-            return setPeriod(0, fine);
+            if (next_ >= time)
+                return 0;
+            const uint32_t ticks = (time - next_ - 1) / interval_ + 1;
+            next_ += ticks * interval_;
+            return ticks;
         }
-
     };
 
-    template <int sample_rate>
-    struct channel_t : periodic_t<sample_rate>
+    struct channel_t : periodic_t
     {
+        // the tone counter ticks at 1/8 of the clock and the output toggles each time it reaches the period, so a
+        // full cycle of the tone is 16 * period clocks
+        static const uint32_t DIVIDER = 8;
+
         uint8_t  amplitude_mode  = 0; // fixed or envelope variable
-        uint8_t  amplitude_fixed;
-        bool enabled, noise_enabled;
-        double radian_;
+        uint8_t  amplitude_fixed = 0;
+        // enabled in the mixer, as after a reset
+        bool enabled = true, noise_enabled = true;
+        uint8_t tone_ = 0;
+        // the level last added to the output, and the stem it was added to
+        int16_t level_ = 0;
+        uint8_t stem_ = 0;
+
+        inline void tick()
+        {
+            tone_ ^= 1;
+            next_ += interval_;
+        }
 
-        int16_t step(int16_t noise, uint8_t envelope)
+        inline void advance(uint32_t ticks)
         {
-            int16_t out;
-
-            if (noise_enabled)
-            {
-                out = noise;
-            }
-            else if (!enabled) // redundant - && !noise_enabled)
-            {
-                // if the channel is disable and the noise is disabled then the sound can be modulated by the volume
-                out = 1;
-            }
-            else // enabled channel
-            {
-                out = (int16_t) ((std::sin(radian_) > 0.0 ? 1.0 : -1.0));
-            }
-
-            radian_ += periodic_t<sample_rate>::velocity_;
-            return out * amplitude(envelope);
+            tone_ ^= ticks & 1;
+        }
 
+        // the output is high when both the tone and the noise are high or disabled
+        inline int16_t level(uint8_t noise, uint8_t envelope_amplitude) const
+        {
+            const int16_t mask = (int16_t) -((tone_ | !enabled) & (noise | !noise_enabled));
+            return (int16_t) (amplitude(envelope_amplitude) & mask);
         }
 
         inline int16_t amplitude(uint8_t envelope_amplitude) const
         {
-            //return periodic_t<sample_rate>::amplitude_table[amplitude_fixed];
-            if (!amplitude_mode)
-                return periodic_t<sample_rate>::amplitude_table[amplitude_fixed];
-            else
-                return periodic_t<sample_rate>::amplitude_table[envelope_amplitude];
+            return amplitude_table[amplitude_mode ? envelope_amplitude : amplitude_fixed];
+        }
+
+        // the stem the channel is heard on, a channel playing noise alone is on the noise stem
+        inline uint8_t stem(uint8_t own) const
+        {
+            return (uint8_t) ((!enabled && noise_enabled) ? (uint8_t) STEM_NOISE : own);
+        }
+
+        // the frequency of the tone in Hz
+        inline double frequency() const
+        {
+            return (double) CLOCK / (16 * period_);
+        }
+
+        // a channel at volume 0 is silent whatever the tone and noise do
+        inline bool audible(bool on) const
+        {
+            return on && (amplitude_mode || amplitude_fixed);
         }
     };
 
-    template <int sample_rate>
-    struct noise_t : periodic_t<sample_rate>
+    struct noise_t : periodic_t
     {
-        uint32_t rng = 1;
-        double tick_count_ = 0.0;
-        // returns one sample, the time period covered by this method is 1/sample_rate
         // the rng is ticking a long at frequency = 1.5e6/(period * 16);
-        int16_t step()
+        static const uint32_t DIVIDER = 16;
+
+        // the position in the LFSR sequence
+        uint32_t index_ = 0;
+
+        inline void tick()
+        {
+            if (++index_ == NOISE_PERIOD)
+                index_ = 0;
+            next_ += interval_;
+        }
+
+        inline void advance(uint32_t ticks)
         {
-            while (tick_count_ > 1.0)
-            {
-                rng ^= (((rng & 1) ^ ((rng >> 3) & 1)) << 17);
-                rng >>= 1;
-                tick_count_ -= 1.0;
-            }
-
-            tick_count_ += periodic_t<sample_rate>::velocity_;
-            return (int16_t) (rng & 1);
+            index_ = (uint32_t) ((index_ + (uint64_t) ticks) % NOISE_PERIOD);
         }
+
+        uint8_t output() const;
     };
 
-    template <int sample_rate>
-    struct envelope_t : periodic_t<sample_rate>
+    struct envelope_t : periodic_t
     {
-        uint8_t counter = 0, envelope_cycle = 0;
-        uint8_t hold, attack, alternate, cont, direction;
-        bool holding = false;
-        double tick_count_ = 0.0;
+        // a ramp of the envelope is 16 steps of 16 * period clocks
+        static const uint32_t DIVIDER = 16;
+        // the shapes are 4 ramps long, after the fourth the envelope repeats the last 2
+        static const uint32_t SHAPE_LENGTH = 64, SHAPE_LOOP = 32;
+
+        uint8_t shape_ = 0;
+        uint8_t position_ = 0;
 
-        void setControl(uint8_t value)
+        // a write to the shape restarts the envelope
+        void setControl(uint32_t time, uint8_t value)
         {
-            hold      = (uint8_t) (value & 1);
-            attack    = (uint8_t) ((value >> 1) & 1);
-            alternate = (uint8_t) ((value >> 2) & 1);
-            cont      = (uint8_t) ((value >> 3) & 1);
-            direction = attack;
-            holding   = false;
-            //printf("Envelope control changed: continue=%d, attack=%d, alternate=%d, hold=%d\n",
-            //           cont, attack, alternate, hold);
+            shape_ = (uint8_t) (value & 0xf);
+            position_ = 0;
+            next_ = time + interval_;
         }
 
-        inline void step_cycle()
+        inline void tick()
         {
-            // the divider is really 256 but we need the counter to go at 16 * that
-            // ie. a cycle last 16 ticks (16*16 = 265)
-            if ((envelope_cycle++ & 0xf) == 0xf)
-            {
-                envelope_cycle = 0;
-
-                holding = hold;
-                // toggle the direction of the counter
-                if (alternate)
-                {
-                    direction ^= 1;
-                }
-
-                if (cont)
-                {
-                    counter = 0;
-                }
-            }
+            if (++position_ == SHAPE_LENGTH)
+                position_ = SHAPE_LOOP;
+            next_ += interval_;
         }
 
-        uint8_t step()
+        inline void advance(uint32_t ticks)
         {
-            while (tick_count_ > 1.0)
-            {
-                //if ((!direction && counter > 0) || (direction && counter < 0xf))
-                //    printf("ticking envelop sub-cycle: counter=%d going %s (holding: %d)\n", counter, (direction) ? "up" : "down", holding);
-
-                step_cycle();
-                if (!holding)
-                {
-                    // direction can be toggled by the alternate flag
-                    // count down to 0 when direction/attack is 0
-                    if (!direction && counter > 0)
-                    {
-                        counter -= 1;
-                    }
-                    // count up to 0xf when direction/attack is 1
-                    else if (direction && counter < 0xf)
-                    {
-                        counter += 1;
-                    }
-                }
-
-                tick_count_ -= 1.0;
-            }
-
-            tick_count_ += periodic_t<sample_rate>::velocity_;
-            return (uint8_t) (counter & 0xf);
+            uint64_t position = position_ + (uint64_t) ticks;
+            if (position >= SHAPE_LENGTH)
+                position = SHAPE_LOOP + (position - SHAPE_LOOP) % (SHAPE_LENGTH - SHAPE_LOOP);
+            position_ = (uint8_t) position;
         }
+
+        uint8_t output() const;
     };
 
     uint8_t regs[0xf];
     uint8_t addr;
 
-
     // port a/b read callbacks
     store_reg_callback store_reg_func = nullptr;
 
     intptr_t           store_reg_ref = 0;
     read_io_callback   read_io_func = nullptr;
     intptr_t           read_io_ref = 0;
+
+    BlipBuffer output_;
+    // the cycle the current frame started at, and the time the generators have been run to
+    uint64_t frame_cycle_ = 0;
+    uint32_t time_ = 0;
+    std::vector<int16_t> samples_;
+
+    // the separate outputs of each channel and the DAC, only rendered when they are enabled
+    std::vector<BlipBuffer> stems_;
+
+    // the level of the DAC in the output
+    int16_t dac_level_ = 0;
+    // the output rate, and the adjustment to it that is being moved towards
+    double sample_rate_ = 44100.0;
+    double rate_adjust_ = 1.0, target_adjust_ = 1.0;
+
+    uint32_t ClockTime(uint64_t cycle);
+    void Run(uint32_t end);
+    void UpdateActive(uint32_t time);
+    void SkipInactive(uint32_t time);
+    void UpdateLevels(uint32_t time);
+
 public:
 
     bool channel_a_on = true, channel_b_on = true, channel_c_on = true;
 
-    void Step(uint8_t bus, uint8_t bc1, uint8_t bc2, uint8_t bdir);
+    // full scale of the DAC is about the same as a channel at full volume
+    static const int DAC_SCALE = 0x55;
+
+    // The stems split the output by where it comes from, they add up to the mixed output. A channel that has its
+    // tone disabled and the noise enabled is playing noise alone and goes to the noise stem, otherwise the noise is
+    // part of the channels it is mixed in to.
+    enum stem_t {
+        STEM_A,
+        STEM_B,
+        STEM_C,
+        STEM_NOISE,
+        STEM_DAC,
+        STEM_COUNT
+    };
+
+    AY38910();
+
+    // Render the stems as well as the mixed output. The samples that have not been read yet are dropped, so this is
+    // best called before running
+    void EnableStems(bool enabled);
+    bool StemsEnabled() const;
+
+    // Set the output sample rate, the generators run at the PSG clock and are resampled to it
+    void SetSampleRate(double rate);
+    // Scale the sample rate by adjust to make slightly more or fewer samples, the change is spread over a number
+    // of frames so that the pitch does not jump
+    void SetRateAdjust(double adjust);
+
+    void Step(uint8_t bus, uint8_t bc1, uint8_t bc2, uint8_t bdir, uint64_t cycle);
     void SetIOReadCallback(read_io_callback func, intptr_t ref);
     void SetRegStoreCallback(store_reg_callback func, intptr_t ref);
+    // Write a register at a CPU cycle, the output up to that cycle is rendered with the old value first
+    void Write(uint8_t reg, uint8_t value, uint64_t cycle);
+    // Write a register at the time the output was last rendered to
     void Write(uint8_t reg, uint8_t value);
-    void FillBuffer(uint8_t * const buffer, size_t length);
-
-    channel_t<44100> channel_a, channel_b, channel_c;
-    noise_t<44100> channel_noise;
-    envelope_t<44100> envelope;
+    // Set the Vectrex DAC value at cycle, the DAC is mixed with the PSG when the multiplexer selects the sound output
+    void WriteDAC(int8_t value, uint64_t cycle);
+    // Render the output up to cycle, the samples up to there can then be read with FillBuffer
+    void EndFrame(uint64_t cycle);
+    size_t SamplesAvailable() const;
+    // Read up to frames of interleaved 16-bit stereo samples, returns the number of frames read
+    size_t FillBuffer(int16_t * const buffer, size_t frames);
+    // Read up to frames of the stems, STEM_COUNT interleaved 16-bit samples a frame, returns the number of frames
+    // read. The stems are rendered alongside the mixed output, the same number of frames has to be read from both
+    size_t FillStems(int16_t * const buffer, size_t frames);
+
+    channel_t channel_a, channel_b, channel_c;
+    noise_t channel_noise;
+    envelope_t envelope;
 };
 
 
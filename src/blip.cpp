@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "blip.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// the kernel for each phase, with an extra phase so that the interpolation can always read the next one
+struct blip_kernel_t
+{
+    int16_t taps[BlipBuffer::PHASES + 1][BlipBuffer::WIDTH];
+
+    blip_kernel_t()
+    {
+        const double pi = std::acos(-1.0);
+        const int half = BlipBuffer::WIDTH / 2;
+        // the cutoff is a little below the nyquist frequency so that the transition band fits in the kernel
+        const double cutoff = 0.9;
+
+        for (int p = 0; p <= BlipBuffer::PHASES; p++)
+        {
+            // the step is at p / PHASES of a sample after tap half - 1
+            double kernel[BlipBuffer::WIDTH];
+            double sum = 0.0;
+            for (int k = 0; k < BlipBuffer::WIDTH; k++)
+            {
+                const double x = k - (half - 1) - static_cast<double>(p) / BlipBuffer::PHASES;
+                const double y = pi * cutoff * x;
+                const double sinc = (y == 0.0) ? 1.0 : std::sin(y) / y;
+                // blackman window over -half..half
+                const double w = 0.42 + 0.5 * std::cos(pi * x / half) + 0.08 * std::cos(2.0 * pi * x / half);
+                kernel[k] = sinc * std::max(w, 0.0);
+                sum += kernel[k];
+            }
+
+            // scale so the taps sum to exactly 1 << KERNEL_BITS, then the steps add up to the deltas
+            int total = 0;
+            for (int k = 0; k < BlipBuffer::WIDTH; k++)
+            {
+                taps[p][k] = static_cast<int16_t>(std::lround(kernel[k] / sum * (1 << BlipBuffer::KERNEL_BITS)));
+                total += taps[p][k];
+            }
+            taps[p][half - 1 + (p * 2 >= BlipBuffer::PHASES)] += (1 << BlipBuffer::KERNEL_BITS) - total;
+        }
+    }
+};
+
+const blip_kernel_t kernel;
+
+}
+
+BlipBuffer::BlipBuffer(size_t size) : size_(size), buffer_(size + WIDTH + 1, 0)
+{
+}
+
+void BlipBuffer::SetRates(double clock_rate, double sample_rate)
+{
+    factor_ = static_cast<uint64_t>(std::llround(sample_rate / clock_rate * 4294967296.0));
+}
+
+void BlipBuffer::Clear()
+{
+    offset_ = 0;
+    integrator_ = 0;
+    std::fill(buffer_.begin(), buffer_.end(), 0);
+}
+
+void BlipBuffer::AddDelta(uint32_t time, int delta)
+{
+    if (delta == 0)
+        return;
+
+    const uint64_t fixed = offset_ + time * factor_;
+    const size_t index = static_cast<size_t>(fixed >> 32);
+    if (index > size_)
+        return;
+
+    // the phase and the 0-255 weight of the next phase
+    const auto frac = static_cast<uint32_t>(fixed);
+    const int phase = frac >> (32 - PHASE_BITS);
+    const int interp = (frac >> (32 - PHASE_BITS - 8)) & 0xff;
+    // split the delta between the two phases so that the taps still sum to delta
+    const int32_t da = (delta * (256 - interp)) >> 8;
+    const int32_t db = delta - da;
+
+    const int16_t *a = kernel.taps[phase];
+    const int16_t *b = kernel.taps[phase + 1];
+    int32_t *out = &buffer_[index];
+    for (int k = 0; k < WIDTH; k++)
+        out[k] += a[k] * da + b[k] * db;
+}
+
+void BlipBuffer::EndFrame(uint32_t clocks)
+{
+    offset_ = std::min(offset_ + clocks * factor_, static_cast<uint64_t>(size_) << 32);
+}
+
+uint32_t BlipBuffer::ClocksNeeded(size_t samples) const
+{
+    const uint64_t needed = static_cast<uint64_t>(std::min(samples, size_)) << 32;
+    if (needed <= offset_ || factor_ == 0)
+        return 0;
+    return static_cast<uint32_t>((needed - offset_ + factor_ - 1) / factor_);
+}
+
+size_t BlipBuffer::SamplesAvailable() const
+{
+    return static_cast<size_t>(offset_ >> 32);
+}
+
+size_t BlipBuffer::ReadSamples(int16_t *out, size_t count, size_t stride)
+{
+    count = std::min(count, SamplesAvailable());
+
+    int32_t sum = integrator_;
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += buffer_[i];
+        const int32_t s = std::min(std::max(sum >> KERNEL_BITS, -32768), 32767);
+        out[i * stride] = static_cast<int16_t>(s);
+        sum -= s << (KERNEL_BITS - BASS_SHIFT);
+    }
+    integrator_ = sum;
+
+    // move the deltas that are not read yet to the start of the buffer
+    const size_t remain = SamplesAvailable() - count + WIDTH;
+    std::memmove(buffer_.data(), buffer_.data() + count, remain * sizeof(int32_t));
+    std::fill(buffer_.begin() + remain, buffer_.begin() + remain + count, 0);
+    offset_ -= static_cast<uint64_t>(count) << 32;
+    return count;
+}
@@ -0,0 +1,78 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VECTREXIA_BLIP_H
+#define VECTREXIA_BLIP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Band-limited synthesis buffer
+ *
+ * The square waves of the PSG alias badly when they are simply sampled at the output rate. Instead each change of
+ * the output level is added to the buffer as a band-limited step at its exact clock time, and the samples are the
+ * running sum of the buffer. The steps come from a table of windowed sinc impulses at PHASES sub-sample offsets,
+ * interpolated between the two nearest, so a change costs WIDTH multiply-adds and the cost follows the number of
+ * changes rather than the number of samples.
+ *
+ * Times are in clocks since the end of the last frame, a frame is ended once its samples are needed and the
+ * samples are read out. The output is delayed by WIDTH / 2 samples.
+ */
+class BlipBuffer
+{
+public:
+    // taps of the kernel and the number of sub-sample phases
+    static const int WIDTH = 16;
+    static const int PHASE_BITS = 5;
+    static const int PHASES = 1 << PHASE_BITS;
+    // the taps of each phase sum to 1 << KERNEL_BITS
+    static const int KERNEL_BITS = 14;
+    // the output is high passed at about sample_rate / (2 pi 2^BASS_SHIFT), which removes the DC offset
+    static const int BASS_SHIFT = 9;
+
+    // size is the most samples that can be buffered before they are read
+    explicit BlipBuffer(size_t size);
+
+    void SetRates(double clock_rate, double sample_rate);
+    void Clear();
+
+    // Add a change of delta in the output level at time
+    void AddDelta(uint32_t time, int delta);
+
+    // End a frame of clocks, the samples up to the end of the frame can be read
+    void EndFrame(uint32_t clocks);
+
+    // The number of clocks to run for samples more samples to be available
+    uint32_t ClocksNeeded(size_t samples) const;
+    size_t SamplesAvailable() const;
+
+    // Read up to count samples, stride is the distance between samples in out (2 for interleaved stereo)
+    size_t ReadSamples(int16_t *out, size_t count, size_t stride = 1);
+
+private:
+    // output samples per clock and the position of the end of the last frame, in 32.32 fixed point samples
+    uint64_t factor_ = 0;
+    uint64_t offset_ = 0;
+    int32_t integrator_ = 0;
+    size_t size_;
+    std::vector<int32_t> buffer_;
+};
+
+#endif //VECTREXIA_BLIP_H
@@ -0,0 +1,45 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VECTREXIA_FRAMESKIP_H
+#define VECTREXIA_FRAMESKIP_H
+
+#include <cstdio>
+
+// Frame skip, the first skip of every `every` frames are emulated but not drawn
+struct frameskip_t
+{
+    unsigned skip = 0, every = 1;
+
+    // Is frame number `frame` skipped
+    bool skipped(unsigned frame) const
+    {
+        return frame % every < skip;
+    }
+};
+
+// Parse a frame skip option, "n of m" or disabled
+inline frameskip_t parse_frameskip(const char *value)
+{
+    unsigned skip, every;
+    if (std::sscanf(value, "%u of %u", &skip, &every) == 2 && skip < every)
+        return {skip, every};
+    return {};
+}
+
+#endif //VECTREXIA_FRAMESKIP_H
@@ -28,6 +28,8 @@ along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
 #include <memory>
 #include <algorithm>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "veclib.h"
 
 extern uint8_t font8x8_basic[128][8];
@@ -39,7 +41,46 @@ namespace vxgfx
  * color channel blending function
  */
 inline float blend_channel(const float a, const float b, const float t) {
-    return ::sqrt((1.0f - t) * ::pow(a, 2.0f) + t * ::pow(b, 2.0f));
+    return std::sqrt((1.0f - t) * a * a + t * b * b);
+}
+
+/*
+ * Gamma tables for blending, colours are blended in linear space using the same gamma of 2.0 as blend_channel.
+ * to_linear maps an 8 bit channel to 16 bit linear, from_linear maps it back.
+ */
+inline const std::array<uint16_t, 256> &to_linear_lut() {
+    static const auto table = [] {
+        std::array<uint16_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++)
+            t[i] = static_cast<uint16_t>((i * i * 65535u + 65025u / 2u) / 65025u);
+        return t;
+    }();
+    return table;
+}
+
+inline const std::array<uint8_t, 65536> &from_linear_lut() {
+    static const auto table = [] {
+        std::array<uint8_t, 65536> t{};
+        for (int i = 0; i < 65536; i++)
+            t[i] = static_cast<uint8_t>(std::lround(std::sqrt(i / 65535.0) * 255.0));
+        return t;
+    }();
+    return table;
+}
+
+/*
+ * Blend two 8 bit channels in linear space, t is the weight of b in [0, 256]
+ */
+inline uint8_t blend_c8(const uint8_t a, const uint8_t b, const uint32_t t,
+                        const uint16_t *to_linear, const uint8_t *from_linear) {
+    return from_linear[(to_linear[a] * (256u - t) + to_linear[b] * t) >> 8u];
+}
+
+/*
+ * Convert a blend point in [0.0, 1.0] to a weight in [0, 256]
+ */
+inline uint32_t blend_weight(const float t) {
+    return static_cast<uint32_t>(vxl::clamp(t, 0.0f, 1.0f) * 256.0f + 0.5f);
 }
 
 /*
@@ -136,19 +177,28 @@ struct pf_argb_t {
     }
 
     inline pf_argb_t blend(const pf_argb_t &rhs, const float blend_point) const {
+        return blend(rhs, blend_weight(blend_point));
+    }
+
+    // Gamma correct blend, t is the weight of rhs in [0, 256]
+    inline pf_argb_t blend(const pf_argb_t &rhs, const uint32_t t) const {
+        const auto to_linear = to_linear_lut().data();
+        const auto from_linear = from_linear_lut().data();
         return {
-            static_cast<uint8_t>(blend_alpha(a(),   rhs.a(), blend_point) * 255.0f),
-            static_cast<uint8_t>(blend_channel(r(), rhs.r(), blend_point) * 255.0f),
-            static_cast<uint8_t>(blend_channel(g(), rhs.g(), blend_point) * 255.0f),
-            static_cast<uint8_t>(blend_channel(b(), rhs.b(), blend_point) * 255.0f),
+            static_cast<uint8_t>((comp_a(*this) * (256u - t) + comp_a(rhs) * t) >> 8u),
+            blend_c8(comp_r(*this), comp_r(rhs), t, to_linear, from_linear),
+            blend_c8(comp_g(*this), comp_g(rhs), t, to_linear, from_linear),
+            blend_c8(comp_b(*this), comp_b(rhs), t, to_linear, from_linear),
         };
     }
 
+    constexpr static uint8_t add_c8(const value_type c, const int v) {
+        return static_cast<uint8_t>(vxl::clamp(static_cast<int>(c) + v, 0, 255));
+    }
+
     constexpr pf_argb_t brightness(const float v) const {
-        auto r_ = to_c8(vxl::clamp(r() + v, 0.0f, 1.0f));
-        auto g_ = to_c8(vxl::clamp(g() + v, 0.0f, 1.0f));
-        auto b_ = to_c8(vxl::clamp(b() + v, 0.0f, 1.0f));
-        return { r_, g_, b_ };
+        const auto v8 = static_cast<int>(v * 255.0f);
+        return { add_c8(comp_r(*this), v8), add_c8(comp_g(*this), v8), add_c8(comp_b(*this), v8) };
     }
 };
 
@@ -186,18 +236,45 @@ struct pf_rgb565_t {
         return static_cast<uint8_t>(v * 255.0f);
     }
 
+    // the channels expanded to 8 bits
+    constexpr uint8_t r8() const {
+        return static_cast<uint8_t>(comp_r(*this) << 3u | comp_r(*this) >> 2u);
+    }
+
+    constexpr uint8_t g8() const {
+        return static_cast<uint8_t>(comp_g(*this) << 2u | comp_g(*this) >> 4u);
+    }
+
+    constexpr uint8_t b8() const {
+        return static_cast<uint8_t>(comp_b(*this) << 3u | comp_b(*this) >> 2u);
+    }
+
     inline pf_rgb565_t brightness(const float v) const {
-        auto r_ = to_c8(vxl::clamp(r() + v, 0.0f, 1.0f));
-        auto g_ = to_c8(vxl::clamp(g() + v, 0.0f, 1.0f));
-        auto b_ = to_c8(vxl::clamp(b() + v, 0.0f, 1.0f));
-        return { r_, g_, b_ };
+        const auto v8 = static_cast<int>(v * 255.0f);
+        return { pf_argb_t::add_c8(r8(), v8), pf_argb_t::add_c8(g8(), v8), pf_argb_t::add_c8(b8(), v8) };
+    }
+
+    // Gamma correct blend, t is the weight of rhs in [0, 256]
+    inline pf_rgb565_t blend(const pf_rgb565_t &rhs, const uint32_t t) const {
+        const auto to_linear = to_linear_lut().data();
+        const auto from_linear = from_linear_lut().data();
+        return {
+            blend_c8(r8(), rhs.r8(), t, to_linear, from_linear),
+            blend_c8(g8(), rhs.g8(), t, to_linear, from_linear),
+            blend_c8(b8(), rhs.b8(), t, to_linear, from_linear),
+        };
     }
 
-    inline explicit pf_rgb565_t(const pf_argb_t v)
+    inline pf_rgb565_t blend(const pf_rgb565_t &rhs, const float blend_point) const {
+        return blend(rhs, blend_weight(blend_point));
+    }
+
+    // The colour is premultiplied by the alpha
+    constexpr explicit pf_rgb565_t(const pf_argb_t v)
         : pf_rgb565_t(
-            static_cast<uint8_t>(v.r() * v.a()),
-            static_cast<uint8_t>(v.g() * v.a()),
-            static_cast<uint8_t>(v.b() * v.a()))
+            static_cast<uint8_t>((pf_argb_t::comp_r(v) * pf_argb_t::comp_a(v) + 127) / 255),
+            static_cast<uint8_t>((pf_argb_t::comp_g(v) * pf_argb_t::comp_a(v) + 127) / 255),
+            static_cast<uint8_t>((pf_argb_t::comp_b(v) * pf_argb_t::comp_a(v) + 127) / 255))
     { /* ... */ }
 
     constexpr pf_rgb565_t(uint8_t r, uint8_t g, uint8_t b) {
@@ -278,6 +355,72 @@ struct pf_mono_t {
     }
 };
 
+/*
+ * Quantize a monochrome intensity to 8 bits, clamped to [0, 1]
+ */
+inline uint8_t quantize(const pf_mono_t &p) {
+    return static_cast<uint8_t>(vxl::clamp(p.value, 0.0f, 1.0f) * 255.0f);
+}
+
+/*
+ * Lookup table from a quantized monochrome intensity to the output pixel format
+ */
+template<typename Pf>
+struct mono_lut {
+    std::array<Pf, 256> table;
+
+    mono_lut() {
+        for (int i = 0; i < 256; i++) {
+            auto c = static_cast<uint8_t>(i);
+            table[i] = Pf(c, c, c);
+        }
+    }
+
+    const Pf &operator[](const uint8_t i) const {
+        return table[i];
+    }
+};
+
+/*
+ * Blend a span of n ARGB pixels over dst using the alpha of each source pixel. Transparent and opaque source
+ * pixels are the common case for overlays and skip the blend.
+ */
+inline void blend_span(pf_argb_t *dst, const pf_argb_t *src, const size_t n) {
+    const auto to_linear = to_linear_lut().data();
+    const auto from_linear = from_linear_lut().data();
+    for (size_t i = 0; i < n; i++) {
+        const auto a = pf_argb_t::comp_a(src[i]);
+        if (a == 0)
+            continue;
+        if (a == 0xff) {
+            dst[i] = pf_argb_t(src[i].value);
+            continue;
+        }
+        // 0-255 alpha to a 0-256 weight
+        const uint32_t t = a + (a >> 7u);
+        dst[i] = pf_argb_t(
+            static_cast<uint8_t>(pf_argb_t::comp_a(dst[i])),
+            blend_c8(pf_argb_t::comp_r(dst[i]), pf_argb_t::comp_r(src[i]), t, to_linear, from_linear),
+            blend_c8(pf_argb_t::comp_g(dst[i]), pf_argb_t::comp_g(src[i]), t, to_linear, from_linear),
+            blend_c8(pf_argb_t::comp_b(dst[i]), pf_argb_t::comp_b(src[i]), t, to_linear, from_linear));
+    }
+}
+
+inline void blend_span(pf_rgb565_t *dst, const pf_argb_t *src, const size_t n) {
+    const auto to_linear = to_linear_lut().data();
+    const auto from_linear = from_linear_lut().data();
+    for (size_t i = 0; i < n; i++) {
+        const auto a = pf_argb_t::comp_a(src[i]);
+        if (a == 0)
+            continue;
+        const uint32_t t = a + (a >> 7u);
+        dst[i] = pf_rgb565_t(
+            blend_c8(dst[i].r8(), static_cast<uint8_t>(pf_argb_t::comp_r(src[i])), t, to_linear, from_linear),
+            blend_c8(dst[i].g8(), static_cast<uint8_t>(pf_argb_t::comp_g(src[i])), t, to_linear, from_linear),
+            blend_c8(dst[i].b8(), static_cast<uint8_t>(pf_argb_t::comp_b(src[i])), t, to_linear, from_linear));
+    }
+}
+
 /*
  * Line drawing mode: direct (overwrite)
  */
@@ -298,6 +441,19 @@ struct m_brightness {
     }
 };
 
+/*
+ * Line drawing mode: keep the brightest, for monochrome buffers. Antialiased lines that cross do not darken
+ * each other.
+ */
+struct m_max {
+    template<typename Fb, typename Pf = decltype(Fb::value_type)>
+    constexpr void operator()(Fb &fb, size_t pos, const Pf &color) const {
+        auto &p = fb.data()[pos];
+        if (color.value > p.value)
+            p = color;
+    }
+};
+
 /*
  * Line drawing mode: colour blending
  */
@@ -512,6 +668,192 @@ private:
     std::unique_ptr<data_type> buffer{};
 };
 
+/*
+ * Runtime sized framebuffer, same interface as framebuffer<W, H, Pf> but the
+ * dimensions are set on construction or with resize().
+ *
+ * Usage:
+ *    vxgfx::dynamic_framebuffer<PIXEL_FORMAT> buffer{WIDTH, HEIGHT};
+ *
+ */
+template<typename Pf>
+class dynamic_framebuffer
+{
+private:
+    using data_type = std::vector<Pf>;
+public:
+
+    //
+    // define some types that can referenced by others
+
+    using value_type = Pf;
+    using pointer = value_type * ;
+    using reference = value_type & ;
+    using iterator = typename data_type::iterator;
+    using const_iterator = typename data_type::const_iterator;
+
+    // read only, use resize() to change the dimensions
+    int width = 0;
+    int height = 0;
+
+    //
+    // STL compatible iterator pass-throughs
+
+    auto begin()->iterator {
+        return buffer.begin();
+    }
+
+    auto begin() const ->const_iterator {
+        return buffer.cbegin();
+    }
+
+    auto cbegin() const ->const_iterator {
+        return buffer.cbegin();
+    }
+
+    auto end()->iterator {
+        return buffer.end();
+    }
+
+    auto end() const ->const_iterator {
+        return buffer.end();
+    }
+
+    auto cend() const ->const_iterator {
+        return buffer.cend();
+    }
+
+    dynamic_framebuffer() = default;
+
+    dynamic_framebuffer(int w, int h) {
+        resize(w, h);
+    }
+
+    dynamic_framebuffer(int w, int h, Pf c)
+        : dynamic_framebuffer(w, h) {
+        fill(std::move(c));
+    }
+
+    // Changes the dimensions of the buffer, the contents are cleared
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        buffer.assign(static_cast<size_t>(w) * h, Pf{});
+    }
+
+    // Clears the internal vector<> using the pixel format default (Pf)
+    void clear() {
+        std::fill(buffer.begin(), buffer.end(), Pf{});
+    }
+
+    // Fill buffer with colour
+    void fill(Pf c) {
+        std::fill(buffer.begin(), buffer.end(), c);
+    }
+
+    // Fill an area of the buffer with colour, the area is clipped to the buffer
+    void fill(const rect_t &area, Pf c) {
+        const int l = std::max(area.left, 0), r = std::min(area.right, width);
+        const int t = std::max(area.top, 0), b = std::min(area.bottom, height);
+        for (int y = t; y < b && l < r; y++) {
+            std::fill(buffer.begin() + y * width + l, buffer.begin() + y * width + r, c);
+        }
+    }
+
+    // Clears an area of the buffer using the pixel format default (Pf)
+    void clear(const rect_t &area) {
+        fill(area, Pf{});
+    }
+
+    // Returns the number of pixels
+    size_t size() const {
+        return buffer.size();
+    }
+
+    // Returns a pointer to the internal vector<>
+    pointer data() const {
+        return const_cast<pointer>(buffer.data());
+    }
+
+    const rect_t rect() const {
+        return rect_t(width, height);
+    }
+
+    template<typename DrawMode>
+    constexpr void plot_pixel(const int x, const int y, DrawMode mode, Pf color) {
+        if (x < width && x >= 0 && y < height && y >= 0) {
+            mode(*this, (y * width) + x, color);
+        }
+    }
+
+    const Pf get_pixel(const int x, const int y) const {
+        return (x < width && x >= 0 && y < height && y >= 0)
+            ? buffer[(y * width) + x] : Pf();
+    }
+
+    // Copy n pixels from src to row y starting at x, the span is clipped to the buffer
+    void blit_span(int x, const int y, const Pf *src, int n) {
+        if (y < 0 || y >= height)
+            return;
+        if (x < 0) {
+            src -= x;
+            n += x;
+            x = 0;
+        }
+        n = std::min(n, width - x);
+        if (n > 0)
+            std::copy(src, src + n, buffer.begin() + y * width + x);
+    }
+
+private:
+    data_type buffer{};
+};
+
+/*
+ * Box filter downsample of a monochrome buffer, each destination pixel is the
+ * average of a factor x factor block of source pixels. Only the area of the
+ * destination is updated.
+ *
+ * The vectors are always drawn 1 pixel wide, so a line in the source buffer
+ * is 1/factor of a destination pixel wide. The average is scaled back up by
+ * factor so that lines keep the brightness they have at native resolution.
+ */
+template<typename Dst, typename Src>
+void downsample_box(Dst &dst, const Src &src, const int factor, const rect_t &area)
+{
+    const float gain = 1.0f / factor;
+    const int l = std::max(area.left, 0);
+    const int t = std::max(area.top, 0);
+    const int r = std::min({ area.right, dst.width, src.width / factor });
+    const int b = std::min({ area.bottom, dst.height, src.height / factor });
+    auto rawDst = dst.data();
+    auto rawSrc = src.data();
+
+    for (int y = t; y < b; y++) {
+        auto dstRow = rawDst + y * dst.width;
+        for (int x = l; x < r; x++) {
+            dstRow[x].value = 0.0f;
+        }
+        for (int sy = 0; sy < factor; sy++) {
+            auto srcRow = rawSrc + (y * factor + sy) * src.width;
+            for (int x = l; x < r; x++) {
+                for (int sx = 0; sx < factor; sx++) {
+                    dstRow[x].value += srcRow[x * factor + sx].value;
+                }
+            }
+        }
+        for (int x = l; x < r; x++) {
+            dstRow[x].value = std::min(dstRow[x].value * gain, 1.0f);
+        }
+    }
+}
+
+template<typename Dst, typename Src>
+void downsample_box(Dst &dst, const Src &src, const int factor)
+{
+    downsample_box(dst, src, factor, dst.rect());
+}
+
 /*
  * vectrex viewport voltage span
  */
@@ -572,22 +914,20 @@ void draw_line(T &fb, int x0, int y0, int x1, int y1, const Pf &c)
 }
 
 /*
- * Antialiased line drawing. No endpoint calculations due to int coordinates.
+ * Antialiased line drawing, the coordinates are fixed point with AA_SUBPIXEL_BITS of sub-pixel precision.
  * https://en.wikipedia.org/wiki/Xiaolin_Wu's_line_algorithm
  *
- * TODO: Optimization for horizontal and vertical lines. Currently, no matter
- * the drawing direction, it will always call plot_pixel() twice even when not
- * needed, for instance when the brightness for one of them is 0.0f which is
- * the case for vertical and horizontal lines.
+ * Each column (or row for steep lines) is split between the two pixels nearest to the line, pixels that get no
+ * coverage are not plotted, so horizontal and vertical lines on a pixel centre plot one pixel per step. There
+ * are no endpoint calculations, the end columns are drawn at full coverage.
  */
+constexpr int AA_SUBPIXEL_BITS = 8;
+constexpr int AA_SUBPIXEL = 1 << AA_SUBPIXEL_BITS;
+
 template<typename DrawMode, typename T, typename Pf = decltype(T::value_type)>
 void draw_aline(T &fb, int x0, int y0, int x1, int y1, const Pf &c)
 {
-    auto itrunc  = [](float v) ->int { return static_cast<int>(v); };
-    auto ftrunc  = [](float v) -> float { return std::floor(v); };
-    auto rftrunc = [](float v) -> float { return 1.0f - std::floor(v); };
-
-    auto steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+    const auto steep = std::abs(y1 - y0) > std::abs(x1 - x0);
     if (steep) {
         std::swap(x0, y0);
         std::swap(x1, y1);
@@ -597,31 +937,25 @@ void draw_aline(T &fb, int x0, int y0, int x1, int y1, const Pf &c)
         std::swap(y0, y1);
     }
 
-    auto iy = static_cast<float>(y0);
-    auto dx = static_cast<float>(x1) - x0;
-    auto dy = static_cast<float>(y1) - y0;
-    auto gradient = (dx == 0.0f) ? 1.0f : dy / dx;
-    
-    if (steep)
-    {
-        for (int x = x0; x <= x1; ++x)
-        {
-            Pf p1 = c * rftrunc(iy);
-            Pf p2 = c * ftrunc(iy);
-            fb.plot_pixel(itrunc(iy), x, DrawMode(), p1);
-            fb.plot_pixel(itrunc(iy) - 1, x, DrawMode(), p2);
-            iy += gradient;
-        }
-    }
-    else
-    {
-        for (int x = x0; x <= x1; ++x)
-        {
-            Pf p1 = c * rftrunc(iy);
-            Pf p2 = c * ftrunc(iy);
-            fb.plot_pixel(x, itrunc(iy), DrawMode(), p1);
-            fb.plot_pixel(x, itrunc(iy) - 1, DrawMode(), p2);
-            iy += gradient;
+    // the minor axis position is 16 bits more precise than the coordinates
+    const int64_t dx = x1 - x0, dy = y1 - y0;
+    const int64_t gradient = (dx == 0) ? 0 : (dy << 16) / dx;
+    const int first = x0 >> AA_SUBPIXEL_BITS, last = x1 >> AA_SUBPIXEL_BITS;
+    // the line at the centre of the first column, offset by half a pixel so that the integer part is the pixel
+    // above the line
+    int64_t iy = (int64_t{ y0 } << 16) + (int64_t{ first } * AA_SUBPIXEL + AA_SUBPIXEL / 2 - x0) * gradient
+                 - (int64_t{ AA_SUBPIXEL / 2 } << 16);
+    const int64_t step = gradient * AA_SUBPIXEL;
+    constexpr float scale = 1.0f / AA_SUBPIXEL;
+
+    for (int x = first; x <= last; x++, iy += step) {
+        const auto y = static_cast<int>(iy >> (16 + AA_SUBPIXEL_BITS));
+        const auto f = static_cast<int>((iy >> 16) & (AA_SUBPIXEL - 1));
+        const Pf p0 = c * ((AA_SUBPIXEL - f) * scale);
+        steep ? fb.plot_pixel(y, x, DrawMode(), p0) : fb.plot_pixel(x, y, DrawMode(), p0);
+        if (f > 0) {
+            const Pf p = c * (f * scale);
+            steep ? fb.plot_pixel(y + 1, x, DrawMode(), p) : fb.plot_pixel(x, y + 1, DrawMode(), p);
         }
     }
 }
@@ -644,7 +978,7 @@ constexpr unsigned int PIXEL_HEIGHT = 8;
 constexpr unsigned int PIXEL_SPACING = 1;
 
 template<typename DrawMode, typename T, typename Pf = decltype(T::value_type)>
-void draw_text(T &fb, int x, int y, const Pf &c, std::string message) {
+void draw_text(T &fb, int x, int y, const Pf &c, std::string_view message) {
     for (auto &m : message) {
         // each character is 8 x 8 pixels
         for (auto y_pixel = 0; y_pixel < PIXEL_HEIGHT; y_pixel++) {
@@ -659,6 +993,105 @@ void draw_text(T &fb, int x, int y, const Pf &c, std::string message) {
     }
 }
 
+/*
+ * The font pre-rasterized in one colour. Each row of a glyph is stored as the runs of set pixels, so drawing a
+ * character is a few span copies instead of a plot_pixel() per bit.
+ *
+ * Usage:
+ *    static const vxgfx::glyph_atlas<vxgfx::pf_argb_t> font{colour};
+ *    vxgfx::draw_text(fb, x, y, font, "text");
+ */
+template<typename Pf>
+class glyph_atlas
+{
+public:
+    struct run_t
+    {
+        uint8_t x, length;
+    };
+
+    // an 8 pixel row has at most 4 runs
+    static constexpr int MAX_RUNS = PIXEL_WIDTH / 2;
+
+    struct glyph_row_t
+    {
+        uint8_t count = 0;
+        std::array<run_t, MAX_RUNS> runs{};
+    };
+
+    struct glyph_t
+    {
+        std::array<glyph_row_t, PIXEL_HEIGHT> rows{};
+        // the rows that have pixels, blank glyphs (eg. space) are skipped
+        uint8_t top = 0, bottom = 0;
+    };
+
+    explicit glyph_atlas(const Pf &c) {
+        ink.fill(c);
+        for (unsigned ch = 0; ch < glyphs.size(); ch++) {
+            auto &glyph = glyphs[ch];
+            glyph.top = PIXEL_HEIGHT;
+            for (unsigned y = 0; y < PIXEL_HEIGHT; y++) {
+                const unsigned bits = font8x8_basic[ch][y];
+                auto &row = glyph.rows[y];
+                // the least significant bit is the left most pixel
+                for (unsigned x = 0; x < PIXEL_WIDTH; x++) {
+                    if (!(bits & (1u << x)))
+                        continue;
+                    if (x > 0 && (bits & (1u << (x - 1))))
+                        row.runs[row.count - 1].length++;
+                    else
+                        row.runs[row.count++] = run_t{ static_cast<uint8_t>(x), 1 };
+                }
+                if (row.count) {
+                    glyph.top = std::min<uint8_t>(glyph.top, y);
+                    glyph.bottom = y + 1;
+                }
+            }
+            if (glyph.top > glyph.bottom)
+                glyph.top = glyph.bottom;
+        }
+    }
+
+    const glyph_t &operator[](const char c) const {
+        return glyphs[c & 0x7fu];
+    }
+
+    // PIXEL_WIDTH pixels of the text colour, the source of every span
+    const Pf *pixels() const {
+        return ink.data();
+    }
+
+private:
+    std::array<glyph_t, 128> glyphs{};
+    std::array<Pf, PIXEL_WIDTH> ink{};
+};
+
+/*
+ * Draw text with a glyph atlas, the pixels are copied so this is the same as draw_text<m_direct>. Characters
+ * that are entirely outside of the buffer are skipped, the others are clipped by blit_span().
+ */
+template<typename T, typename Pf>
+void draw_text(T &fb, int x, int y, const glyph_atlas<Pf> &atlas, std::string_view message) {
+    if (y >= fb.height || y + static_cast<int>(PIXEL_HEIGHT) <= 0)
+        return;
+
+    for (auto &m : message) {
+        if (x >= fb.width)
+            break;
+        if (x + static_cast<int>(PIXEL_WIDTH) > 0) {
+            const auto &glyph = atlas[m];
+            for (int row = glyph.top; row < glyph.bottom; row++) {
+                const auto &r = glyph.rows[row];
+                for (int i = 0; i < r.count; i++) {
+                    fb.blit_span(x + r.runs[i].x, y + row, atlas.pixels(), r.runs[i].length);
+                }
+            }
+        }
+        x += PIXEL_WIDTH + PIXEL_SPACING;
+    }
+}
+
 inline rect_t intersect(const rect_t *a, const rect_t *b) {
 
     const point_t p0{
@@ -679,6 +1112,376 @@ inline rect_t intersect(const rect_t &a, const rect_t &b) {
     return intersect(&a, &b);
 }
 
+/*
+ * Smallest rect that contains both a and b, empty rects are ignored
+ */
+inline rect_t unite(const rect_t &a, const rect_t &b) {
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    return rect_t{
+        point_t{ std::min(a.left, b.left), std::min(a.top, b.top) },
+        point_t{ std::max(a.right, b.right), std::max(a.bottom, b.bottom) }
+    };
+}
+
+/*
+ * A list of areas of a framebuffer that have been drawn to. Overlapping areas
+ * are merged, and once the list is full new areas are merged in to the last
+ * one, so the number of rects stays small.
+ */
+class dirty_region
+{
+    std::vector<rect_t> rects;
+    size_t max_rects;
+
+public:
+    using const_iterator = std::vector<rect_t>::const_iterator;
+
+    explicit dirty_region(size_t max = 32) : max_rects(max) {
+        rects.reserve(max_rects);
+    }
+
+    void add(const rect_t &r) {
+        if (!r)
+            return;
+
+        for (auto &e : rects) {
+            if (intersect(e, r)) {
+                e = unite(e, r);
+                return;
+            }
+        }
+
+        if (rects.size() < max_rects)
+            rects.push_back(r);
+        else
+            rects.back() = unite(rects.back(), r);
+    }
+
+    void add(const dirty_region &other) {
+        for (const auto &r : other)
+            add(r);
+    }
+
+    void clear() {
+        rects.clear();
+    }
+
+    bool empty() const {
+        return rects.empty();
+    }
+
+    size_t size() const {
+        return rects.size();
+    }
+
+    // total number of pixels covered, overlapping areas are counted twice
+    int area() const {
+        int a = 0;
+        for (const auto &r : rects)
+            a += r.area();
+        return a;
+    }
+
+    const_iterator begin() const {
+        return rects.cbegin();
+    }
+
+    const_iterator end() const {
+        return rects.cend();
+    }
+};
+
+/*
+ * Convert an area of a monochrome framebuffer to another pixel format using
+ * a mono_lut. Each row is converted in chunks, first quantizing the
+ * intensities and then looking them up, so that the quantize loop has no
+ * dependencies and can be vectorized by the compiler.
+ */
+template<typename Pf, typename SrcPf>
+void convert_mono_row(Pf *dstRow, const SrcPf *srcRow, const mono_lut<Pf> &lut, const int left, const int right)
+{
+    constexpr int CHUNK = 256;
+    std::array<uint8_t, CHUNK> q;
+
+    for (int x0 = left; x0 < right; x0 += CHUNK) {
+        const int n = std::min(CHUNK, right - x0);
+        for (int i = 0; i < n; i++) {
+            q[i] = quantize(srcRow[x0 + i]);
+        }
+        for (int i = 0; i < n; i++) {
+            dstRow[x0 + i] = lut[q[i]];
+        }
+    }
+}
+
+template<typename Dst, typename Src, typename Pf = typename Dst::value_type>
+void convert_mono(Dst &dst, const Src &src, const mono_lut<Pf> &lut, const rect_t &area)
+{
+    const auto r = intersect(intersect(area, src.rect()), dst.rect());
+    if (!r)
+        return;
+
+    auto rawDst = dst.data();
+    auto rawSrc = src.data();
+    for (int y = r.top; y < r.bottom; y++) {
+        convert_mono_row(rawDst + y * dst.width, rawSrc + y * src.width, lut, r.left, r.right);
+    }
+}
+
+template<typename Dst, typename Src, typename Pf = typename Dst::value_type>
+void convert_mono(Dst &dst, const Src &src, const mono_lut<Pf> &lut)
+{
+    convert_mono(dst, src, lut, src.rect());
+}
+
+/*
+ * An ARGB layer that is composited on top of the output, eg. the debug text. It starts out transparent and
+ * keeps a coverage bitmap of the TILE x TILE tiles that have been drawn to, so only those tiles have to be
+ * composited and cleared.
+ */
+template<typename Pf>
+class overlay_buffer : public dynamic_framebuffer<Pf>
+{
+    using base = dynamic_framebuffer<Pf>;
+
+    // one bit per tile, each row of tiles starts on a new word
+    std::vector<uint64_t> coverage, prev_coverage;
+    int words_per_row = 0;
+    int tiles_y = 0;
+
+    static Pf transparent() {
+        return Pf(typename Pf::value_type{0});
+    }
+
+    template<typename Fn>
+    static void for_each_run(uint64_t const *row, const int words, Fn fn) {
+        int start = -1;
+        for (int tile = 0; tile <= words * 64; tile++) {
+            const bool set = tile < words * 64 && ((row[tile / 64] >> (tile % 64)) & 1u);
+            if (set && start < 0) {
+                start = tile;
+            } else if (!set && start >= 0) {
+                fn(start, tile);
+                start = -1;
+            }
+        }
+    }
+
+    // mark the tiles of row y from x0 to x1 (inclusive) as covered
+    void mark(const int x0, const int x1, const int y) {
+        auto row = &coverage[(y / TILE) * words_per_row];
+        for (int tile = x0 / TILE; tile <= x1 / TILE; tile++)
+            row[tile / 64] |= uint64_t{1} << (tile % 64);
+    }
+
+public:
+    static constexpr int TILE = 8;
+
+    overlay_buffer() = default;
+
+    overlay_buffer(int w, int h) {
+        resize(w, h);
+    }
+
+    // Changes the dimensions of the buffer, the contents are cleared to transparent
+    void resize(int w, int h) {
+        base::resize(w, h);
+        base::fill(transparent());
+        words_per_row = ((w + TILE - 1) / TILE + 63) / 64;
+        tiles_y = (h + TILE - 1) / TILE;
+        coverage.assign(static_cast<size_t>(words_per_row) * tiles_y, 0);
+        prev_coverage = coverage;
+    }
+
+    template<typename DrawMode>
+    constexpr void plot_pixel(const int x, const int y, DrawMode mode, Pf color) {
+        if (x < base::width && x >= 0 && y < base::height && y >= 0) {
+            mark(x, x, y);
+            mode(*this, (y * base::width) + x, color);
+        }
+    }
+
+    void blit_span(const int x, const int y, const Pf *src, const int n) {
+        const int x0 = std::max(x, 0), x1 = std::min(x + n, base::width);
+        if (y < 0 || y >= base::height || x0 >= x1)
+            return;
+        mark(x0, x1 - 1, y);
+        base::blit_span(x, y, src, n);
+    }
+
+    // Returns true if anything has been drawn to the tile that contains x, y
+    bool covered(const int x, const int y) const {
+        const int tile = x / TILE;
+        return (coverage[(y / TILE) * words_per_row + tile / 64] >> (tile % 64)) & 1u;
+    }
+
+    // Starts a new frame, the tiles drawn in the last frame are cleared
+    void begin_frame() {
+        for (int ty = 0; ty < tiles_y; ty++) {
+            for_each_run(&coverage[ty * words_per_row], words_per_row, [this, ty](int t0, int t1) {
+                base::fill(rect_t{ point_t{ t0 * TILE, ty * TILE }, point_t{ t1 * TILE, (ty + 1) * TILE } },
+                           transparent());
+            });
+        }
+        std::swap(coverage, prev_coverage);
+        std::fill(coverage.begin(), coverage.end(), 0);
+    }
+
+    // Adds the areas that have to be composited again to region, the tiles drawn in this frame and the last
+    void add_changed(dirty_region &region) const {
+        std::vector<uint64_t>::size_type n = 0;
+        std::array<uint64_t, 64> row{};
+        for (int ty = 0; ty < tiles_y; ty++, n += words_per_row) {
+            for (int w = 0; w < words_per_row && w < static_cast<int>(row.size()); w++)
+                row[w] = coverage[n + w] | prev_coverage[n + w];
+            for_each_run(row.data(), std::min<int>(words_per_row, row.size()), [&region, ty](int t0, int t1) {
+                region.add(rect_t{ point_t{ t0 * TILE, ty * TILE }, point_t{ t1 * TILE, (ty + 1) * TILE } });
+            });
+        }
+    }
+
+    // Calls fn(x0, x1) for each run of covered pixels in row y between left and right
+    template<typename Fn>
+    void for_each_span(const int y, const int left, const int right, Fn fn) const {
+        for_each_run(&coverage[(y / TILE) * words_per_row], words_per_row, [=](int t0, int t1) {
+            const int x0 = std::max(t0 * TILE, left), x1 = std::min(t1 * TILE, right);
+            if (x0 < x1)
+                fn(x0, x1);
+        });
+    }
+};
+
+/*
+ * Per pixel tint of a colour screen overlay, matched to the output resolution. A monochrome intensity is
+ * multiplied by the tint of its pixel, so black stays black the way it does under a cellophane overlay.
+ */
+class tint_map : public dynamic_framebuffer<pf_argb_t>
+{
+public:
+    // Resample image to w x h with a bilinear filter, the image covers the whole screen
+    void build(const dynamic_framebuffer<pf_argb_t> &image, const int w, const int h) {
+        resize(w, h);
+        if (image.width <= 0 || image.height <= 0)
+            return;
+
+        // the centre of pixel i in the image, in 24.8 fixed point, clamped to the edge pixels
+        auto sample = [](const int i, const int size, const int image_size) {
+            const int p = std::max(0, static_cast<int>((2 * i + 1) * int64_t{image_size} * 128 / size) - 128);
+            const int index = std::min(p >> 8, image_size - 1);
+            return std::make_pair(index, index + 1 < image_size ? p & 0xff : 0);
+        };
+
+        auto raw = data();
+        auto rawImage = image.data();
+        for (int y = 0; y < h; y++) {
+            const auto sy = sample(y, h, image.height);
+            const auto a = rawImage + sy.first * image.width;
+            const auto b = sy.second ? a + image.width : a;
+            for (int x = 0; x < w; x++) {
+                const auto sx = sample(x, w, image.width);
+                const int x1 = sx.second ? sx.first + 1 : sx.first;
+                auto mix = [&](const uint32_t shift) {
+                    auto c = [shift](const pf_argb_t &p) { return (p.value >> shift) & 0xffu; };
+                    const uint32_t top = c(a[sx.first]) * (256 - sx.second) + c(a[x1]) * sx.second;
+                    const uint32_t bottom = c(b[sx.first]) * (256 - sx.second) + c(b[x1]) * sx.second;
+                    return static_cast<uint8_t>((top * (256 - sy.second) + bottom * sy.second + 32768u) >> 16u);
+                };
+                raw[y * w + x] = pf_argb_t(mix(16), mix(8), mix(0));
+            }
+        }
+    }
+};
+
+/*
+ * Multiply two 8 bit values, the result is rounded so that 255 * c == c
+ */
+constexpr uint8_t mul_c8(const uint32_t a, const uint32_t b) {
+    const uint32_t x = a * b + 128u;
+    return static_cast<uint8_t>((x + (x >> 8u)) >> 8u);
+}
+
+template<typename Pf, typename SrcPf>
+void convert_mono_row(Pf *dstRow, const SrcPf *srcRow, const pf_argb_t *tintRow, const int left, const int right)
+{
+    for (int x = left; x < right; x++) {
+        const uint32_t q = quantize(srcRow[x]);
+        const uint32_t t = tintRow[x].value;
+        dstRow[x] = Pf(mul_c8(q, (t >> 16u) & 0xffu), mul_c8(q, (t >> 8u) & 0xffu), mul_c8(q, t & 0xffu));
+    }
+}
+
+/*
+ * Convert an area of a monochrome framebuffer tinted by a colour overlay
+ */
+template<typename Dst, typename Src>
+void convert_mono(Dst &dst, const Src &src, const tint_map &tint, const rect_t &area)
+{
+    const auto r = intersect(intersect(intersect(area, src.rect()), dst.rect()), tint.rect());
+    if (!r)
+        return;
+
+    auto rawDst = dst.data();
+    auto rawSrc = src.data();
+    auto rawTint = tint.data();
+    for (int y = r.top; y < r.bottom; y++) {
+        convert_mono_row(rawDst + y * dst.width, rawSrc + y * src.width, rawTint + y * tint.width, r.left, r.right);
+    }
+}
+
+/*
+ * Convert an area of a monochrome framebuffer like convert_mono and composite an overlay on top of it in the
+ * same pass, each row is blended while it is still in the cache. Only the covered tiles of the overlay are
+ * blended. convert_row(dstRow, y, left, right) converts a row.
+ */
+template<typename Dst, typename Ov, typename ConvertRow>
+void convert_mono_overlay(Dst &dst, const overlay_buffer<Ov> &overlay, const rect_t &r, ConvertRow convert_row)
+{
+    auto rawDst = dst.data();
+    auto rawOverlay = overlay.data();
+    for (int y = r.top; y < r.bottom; y++) {
+        auto dstRow = rawDst + y * dst.width;
+        auto overlayRow = rawOverlay + y * overlay.width;
+        convert_row(dstRow, y, r.left, r.right);
+        overlay.for_each_span(y, r.left, r.right, [dstRow, overlayRow](int x0, int x1) {
+            blend_span(dstRow + x0, overlayRow + x0, static_cast<size_t>(x1 - x0));
+        });
+    }
+}
+
+template<typename Dst, typename Src, typename Ov, typename Pf = typename Dst::value_type>
+void convert_mono(Dst &dst, const Src &src, const mono_lut<Pf> &lut, const overlay_buffer<Ov> &overlay,
+                  const rect_t &area)
+{
+    const auto r = intersect(intersect(intersect(area, src.rect()), dst.rect()), overlay.rect());
+    if (!r)
+        return;
+
+    auto rawSrc = src.data();
+    convert_mono_overlay(dst, overlay, r, [&src, rawSrc, &lut](Pf *dstRow, int y, int left, int right) {
+        convert_mono_row(dstRow, rawSrc + y * src.width, lut, left, right);
+    });
+}
+
+template<typename Dst, typename Src, typename Ov, typename Pf = typename Dst::value_type>
+void convert_mono(Dst &dst, const Src &src, const tint_map &tint, const overlay_buffer<Ov> &overlay,
+                  const rect_t &area)
+{
+    const auto r = intersect(intersect(intersect(intersect(area, src.rect()), dst.rect()), overlay.rect()),
+                             tint.rect());
+    if (!r)
+        return;
+
+    auto rawSrc = src.data();
+    auto rawTint = tint.data();
+    convert_mono_overlay(dst, overlay, r, [&src, rawSrc, &tint, rawTint](Pf *dstRow, int y, int left, int right) {
+        convert_mono_row(dstRow, rawSrc + y * src.width, rawTint + y * tint.width, left, right);
+    });
+}
+
 struct transform {
     rect_t src;
     rect_t dst;
@@ -0,0 +1,271 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "glow.h"
+#include <algorithm>
+
+// a fully lit low res pixel, 255 in 8.8 fixed point
+static const uint32_t GLOW_ONE = 255u << 8;
+
+void Glow::Configure(glow_quality_t quality, int scale)
+{
+    quality_ = quality;
+    scale = std::max(scale, 1);
+    switch (quality)
+    {
+        case GLOW_LOW:
+            factor_ = 4 * scale;
+            radius_ = 1;
+            passes_ = 1;
+            break;
+        case GLOW_HIGH:
+            factor_ = 2 * scale;
+            radius_ = 2;
+            passes_ = 2;
+            break;
+        default:
+            factor_ = 1;
+            radius_ = 0;
+            passes_ = 0;
+            break;
+    }
+    // rebuilt on the next Apply
+    low_width_ = low_height_ = 0;
+}
+
+bool Glow::enabled() const
+{
+    return quality_ != GLOW_OFF;
+}
+
+int Glow::extent() const
+{
+    return enabled() ? factor_ * (radius_ * passes_ + 1) : 0;
+}
+
+void Glow::resize(int width, int height)
+{
+    low_width_ = (width + factor_ - 1) / factor_;
+    low_height_ = (height + factor_ - 1) / factor_;
+
+    // the blurred buffer has an extra column and row so that the bilinear filter can always read the next sample
+    const size_t stride = low_width_ + 1;
+    low_.assign(low_width_ * low_height_, 0);
+    scratch_.assign(low_width_ * low_height_, 0);
+    blurred_.assign(stride * (low_height_ + 1), 0);
+    column_sums_.assign(low_width_, 0);
+    row_.assign(stride, 0);
+    sums_.assign(width, 0.0f);
+    up_.assign(width, 0);
+
+    // the centre of output pixel x is at (x + 0.5) / factor - 0.5 in the low res buffer, in 24.8 fixed point
+    auto build = [this](int size, int low_size, std::vector<int> &index, std::vector<uint16_t> &weight) {
+        index.resize(size);
+        weight.resize(size);
+        for (int i = 0; i < size; i++)
+        {
+            const int p = (2 * i + 1) * 128 / factor_ - 128;
+            if (p < 0)
+            {
+                index[i] = 0;
+                weight[i] = 0;
+            }
+            else if ((p >> 8) >= low_size - 1)
+            {
+                index[i] = low_size - 1;
+                weight[i] = 0;
+            }
+            else
+            {
+                index[i] = p >> 8;
+                weight[i] = static_cast<uint16_t>(p & 0xff);
+            }
+        }
+    };
+    build(width, low_width_, col_index_, col_weight_);
+    build(height, low_height_, row_index_, row_weight_);
+}
+
+void Glow::downsample(const buffer_t &src, const vxgfx::rect_t &area)
+{
+    const int bx0 = std::max(area.left, 0) / factor_;
+    const int by0 = std::max(area.top, 0) / factor_;
+    const int bx1 = std::min((area.right + factor_ - 1) / factor_, low_width_);
+    const int by1 = std::min((area.bottom + factor_ - 1) / factor_, low_height_);
+    const float scale = static_cast<float>(GLOW_ONE) / (factor_ * factor_);
+    const int x0 = bx0 * factor_, x1 = std::min(bx1 * factor_, src.width);
+    const auto raw = src.data();
+
+    for (int by = by0; by < by1; by++)
+    {
+        // sum the rows of the block row first, the inner loop runs along the row, then sum each block
+        std::fill(sums_.begin() + x0, sums_.begin() + x1, 0.0f);
+        const int y1 = std::min((by + 1) * factor_, src.height);
+        for (int y = by * factor_; y < y1; y++)
+        {
+            auto srcRow = raw + y * src.width;
+            for (int x = x0; x < x1; x++)
+                sums_[x] += std::min(std::max(srcRow[x].value, 0.0f), 1.0f);
+        }
+
+        auto row = &low_[by * low_width_];
+        for (int bx = bx0; bx < bx1; bx++)
+        {
+            const int end = std::min((bx + 1) * factor_, x1);
+            float sum = 0.0f;
+            for (int x = bx * factor_; x < end; x++)
+                sum += sums_[x];
+            row[bx] = static_cast<uint16_t>(sum * scale);
+        }
+    }
+}
+
+void Glow::blur()
+{
+    const int w = low_width_, h = low_height_, r = radius_;
+    const size_t stride = w + 1;
+    // the window sum is at most GLOW_ONE * (2r + 1), multiplying by the reciprocal stays in 32 bits
+    const uint32_t recip = 65536u / (2 * r + 1);
+
+    const uint16_t *in = low_.data();
+    size_t in_stride = w;
+    for (int pass = 0; pass < passes_; pass++)
+    {
+        // horizontal, in to scratch
+        for (int y = 0; y < h; y++)
+        {
+            auto src = in + y * in_stride;
+            auto dst = &scratch_[y * w];
+            uint32_t sum = 0;
+            for (int x = 0; x <= r && x < w; x++)
+                sum += src[x];
+            for (int x = 0; x < w; x++)
+            {
+                dst[x] = static_cast<uint16_t>((sum * recip) >> 16);
+                if (x + r + 1 < w)
+                    sum += src[x + r + 1];
+                if (x - r >= 0)
+                    sum -= src[x - r];
+            }
+        }
+
+        // vertical, in to blurred, a row of column sums at a time so the inner loops run along the rows
+        std::fill(column_sums_.begin(), column_sums_.end(), 0);
+        for (int y = 0; y <= r && y < h; y++)
+        {
+            auto src = &scratch_[y * w];
+            for (int x = 0; x < w; x++)
+                column_sums_[x] += src[x];
+        }
+        for (int y = 0; y < h; y++)
+        {
+            auto dst = &blurred_[y * stride];
+            for (int x = 0; x < w; x++)
+                dst[x] = static_cast<uint16_t>((column_sums_[x] * recip) >> 16);
+            if (y + r + 1 < h)
+            {
+                auto add = &scratch_[(y + r + 1) * w];
+                for (int x = 0; x < w; x++)
+                    column_sums_[x] += add[x];
+            }
+            if (y - r >= 0)
+            {
+                auto sub = &scratch_[(y - r) * w];
+                for (int x = 0; x < w; x++)
+                    column_sums_[x] -= sub[x];
+            }
+        }
+
+        in = blurred_.data();
+        in_stride = stride;
+    }
+}
+
+void Glow::add(const buffer_t &src, buffer_t &dst, const vxgfx::rect_t &area)
+{
+    const auto r = vxgfx::intersect(area, src.rect());
+    if (!r)
+        return;
+
+    const size_t stride = low_width_ + 1;
+    // the bilinear result is GLOW_ONE scaled by 256 * 256
+    const float k = gain / (GLOW_ONE * 65536.0f);
+    const auto rawSrc = src.data();
+    const auto rawDst = dst.data();
+
+    for (int y = r.top; y < r.bottom; y++)
+    {
+        // interpolate between the two low res rows first, then along the row for each pixel
+        const uint16_t *a = &blurred_[row_index_[y] * stride];
+        const uint16_t *b = a + stride;
+        const uint32_t wy = row_weight_[y];
+        for (size_t x = 0; x < stride; x++)
+            row_[x] = a[x] * (256 - wy) + b[x] * wy;
+
+        for (int x = r.left; x < r.right; x++)
+        {
+            const int ix = col_index_[x];
+            const uint32_t wx = col_weight_[x];
+            up_[x] = row_[ix] * (256 - wx) + row_[ix + 1] * wx;
+        }
+
+        auto srcRow = rawSrc + y * src.width;
+        auto dstRow = rawDst + y * dst.width;
+        for (int x = r.left; x < r.right; x++)
+            dstRow[x].value = std::min(srcRow[x].value + up_[x] * k, 1.0f);
+    }
+}
+
+void Glow::Apply(const buffer_t &src, buffer_t &dst, vxgfx::dirty_region &changed)
+{
+    if (!enabled())
+        return;
+
+    const bool full = dst.width != src.width || dst.height != src.height || low_width_ == 0;
+    if (full)
+    {
+        dst.resize(src.width, src.height);
+        resize(src.width, src.height);
+        downsample(src, src.rect());
+    }
+    else
+    {
+        for (const auto &r : changed)
+            downsample(src, r);
+    }
+
+    blur();
+
+    grown_.clear();
+    if (full)
+    {
+        grown_.add(src.rect());
+    }
+    else
+    {
+        const int e = extent();
+        for (const auto &r : changed)
+            grown_.add(vxgfx::intersect(vxgfx::rect_t{ vxgfx::point_t{ r.left - e, r.top - e },
+                                                       vxgfx::point_t{ r.right + e, r.bottom + e } }, src.rect()));
+    }
+
+    for (const auto &r : grown_)
+        add(src, dst, r);
+
+    changed = grown_;
+}
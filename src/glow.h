@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VECTREXIA_GLOW_H
+#define VECTREXIA_GLOW_H
+
+#include <cstdint>
+#include <vector>
+#include "gfxutil.h"
+
+enum glow_quality_t {
+    GLOW_OFF = 0,
+    GLOW_LOW,
+    GLOW_HIGH,
+};
+
+/*
+ * Phosphor glow
+ *
+ * The bright lines on a vector monitor bleed in to the phosphor around them. The glow is approximated by box
+ * blurring a downsampled copy of the vector buffer and adding it back on top, bilinearly upsampled. The blur
+ * is done in 8.8 fixed point on the small buffer, which is the same size at every output scale, so the cost
+ * is mostly the add back over the areas that changed.
+ */
+class Glow
+{
+public:
+    using buffer_t = vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t>;
+
+    // Set the quality for an output scale (the output is scale * native resolution)
+    void Configure(glow_quality_t quality, int scale);
+
+    bool enabled() const;
+
+    // How far the glow reaches from a lit pixel, in output pixels
+    int extent() const;
+
+    // Update dst to src with the glow added. Only the areas of src in changed are assumed to have changed since
+    // the last call, the areas are grown by extent() to cover the glow around them.
+    void Apply(const buffer_t &src, buffer_t &dst, vxgfx::dirty_region &changed);
+
+    // amount of the glow that is added to the lines
+    float gain = 0.5f;
+
+private:
+    glow_quality_t quality_ = GLOW_OFF;
+    // downsample factor, blur radius and number of blur passes
+    int factor_ = 1;
+    int radius_ = 0;
+    int passes_ = 0;
+
+    // the downsampled source and the blurred result, 8.8 fixed point intensities
+    int low_width_ = 0, low_height_ = 0;
+    std::vector<uint16_t> low_, blurred_, scratch_;
+    std::vector<uint32_t> column_sums_;
+    // a row of the blurred buffer interpolated between two rows, 16.16 fixed point
+    std::vector<uint32_t> row_;
+    // a row of the blurred buffer upsampled to the output width, 16.16 fixed point
+    std::vector<uint32_t> up_;
+    // the source rows of a row of blocks summed, used when downsampling
+    std::vector<float> sums_;
+
+    // bilinear upsampling, the low res index and the 0-256 weight of the next sample for each column/row
+    std::vector<int> col_index_, row_index_;
+    std::vector<uint16_t> col_weight_, row_weight_;
+
+    vxgfx::dirty_region grown_{};
+
+    void resize(int width, int height);
+    void downsample(const buffer_t &src, const vxgfx::rect_t &area);
+    void blur();
+    void add(const buffer_t &src, buffer_t &dst, const vxgfx::rect_t &area);
+};
+
+#endif //VECTREXIA_GLOW_H
@@ -0,0 +1,120 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "governor.h"
+#include <algorithm>
+
+void QualityGovernor::SetMaximum(const render_quality_t &max)
+{
+    if (max.antialias == maximum_.antialias && max.glow == maximum_.glow && max.supersample == maximum_.supersample
+        && !ladder_.empty())
+        return;
+
+    maximum_ = max;
+    ladder_.clear();
+
+    auto q = max;
+    ladder_.push_back(q);
+    while (q.supersample > 1)
+    {
+        q.supersample /= 2;
+        ladder_.push_back(q);
+    }
+    while (q.glow != GLOW_OFF)
+    {
+        q.glow = static_cast<glow_quality_t>(q.glow - 1);
+        ladder_.push_back(q);
+    }
+    if (q.antialias)
+    {
+        q.antialias = false;
+        ladder_.push_back(q);
+    }
+
+    up_frames_ = UP_FRAMES;
+    change(0);
+}
+
+void QualityGovernor::SetBudget(int64_t budget_us)
+{
+    budget_us = std::max<int64_t>(budget_us, 0);
+    if (budget_us == budget_)
+        return;
+
+    budget_ = budget_us;
+    up_frames_ = UP_FRAMES;
+    change(0);
+}
+
+bool QualityGovernor::Update(int64_t frame_us)
+{
+    if (budget_ == 0)
+        return false;
+
+    average_ = (average_ < 0) ? frame_us : average_ + (frame_us - average_) / 8;
+    since_up_ = std::min(since_up_ + 1, 2 * MAX_UP_FRAMES);
+
+    if (hold_ > 0)
+    {
+        hold_--;
+        return false;
+    }
+
+    over_ = (average_ > budget_) ? over_ + 1 : 0;
+    // well under the budget, the next level up is more expensive
+    under_ = (average_ * 5 < budget_ * 3) ? under_ + 1 : 0;
+
+    if (over_ >= DOWN_FRAMES && level_ + 1 < ladder_.size())
+    {
+        // the last step up did not last, wait longer before trying again
+        if (since_up_ < 2 * up_frames_)
+            up_frames_ = std::min(up_frames_ * 2, MAX_UP_FRAMES);
+        change(level_ + 1);
+        return true;
+    }
+    if (under_ >= up_frames_ && level_ > 0)
+    {
+        change(level_ - 1);
+        since_up_ = 0;
+        return true;
+    }
+    return false;
+}
+
+const render_quality_t &QualityGovernor::current() const
+{
+    return ladder_[level_];
+}
+
+int64_t QualityGovernor::average() const
+{
+    return std::max<int64_t>(average_, 0);
+}
+
+size_t QualityGovernor::level() const
+{
+    return level_;
+}
+
+void QualityGovernor::change(size_t level)
+{
+    level_ = std::min(level, ladder_.size() - 1);
+    over_ = under_ = 0;
+    hold_ = HOLD_FRAMES;
+    average_ = -1;
+}
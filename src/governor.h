@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VECTREXIA_GOVERNOR_H
+#define VECTREXIA_GOVERNOR_H
+
+#include <cstdint>
+#include <vector>
+#include "glow.h"
+
+// The render settings the governor can change
+struct render_quality_t
+{
+    bool antialias = false;
+    glow_quality_t glow = GLOW_OFF;
+    int supersample = 1;
+};
+
+/*
+ * Render quality governor
+ *
+ * Keeps the time spent drawing and converting a frame within a budget. The settings the user picked are the
+ * top of a ladder of cheaper settings: the supersample factor is halved first, then the glow is reduced and
+ * finally the lines are drawn without antialiasing. When the smoothed frame time is over the budget for a few
+ * frames the governor steps down, it only steps back up after a long run of frames well under the budget. If
+ * a step up does not last, the wait before the next step up doubles, so the image does not flicker between
+ * two settings.
+ */
+class QualityGovernor
+{
+public:
+    // frames over the budget before stepping down, and under before stepping up
+    static constexpr int DOWN_FRAMES = 10;
+    static constexpr int UP_FRAMES = 120;
+    static constexpr int MAX_UP_FRAMES = 3600;
+    // frames to wait after a change, to let the frame time settle
+    static constexpr int HOLD_FRAMES = 30;
+
+    // Set the best settings, the governor starts at these
+    void SetMaximum(const render_quality_t &max);
+
+    // Set the budget in microseconds, 0 disables the governor and the maximum settings are used
+    void SetBudget(int64_t budget_us);
+
+    // Add the time it took to render a frame, returns true if the settings changed
+    bool Update(int64_t frame_us);
+
+    // The settings to render the next frame with
+    const render_quality_t &current() const;
+
+    // The smoothed frame time in microseconds
+    int64_t average() const;
+
+    // 0 is the maximum settings, higher levels are cheaper
+    size_t level() const;
+
+private:
+    std::vector<render_quality_t> ladder_{ render_quality_t{} };
+    render_quality_t maximum_{};
+    size_t level_ = 0;
+    int64_t budget_ = 0;
+    // exponential moving average of the frame time, 1/8 weight for each new frame
+    int64_t average_ = -1;
+    int over_ = 0, under_ = 0;
+    int hold_ = 0;
+    // frames under budget needed to step up, and the frames since the last step up
+    int up_frames_ = UP_FRAMES;
+    int since_up_ = 2 * MAX_UP_FRAMES;
+
+    void change(size_t level);
+};
+
+#endif //VECTREXIA_GOVERNOR_H
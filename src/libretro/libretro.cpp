@@ -16,10 +16,13 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
 #include <memory>
+#include <string>
+#include <chrono>
 
 #if _MSC_VER >= 1910 && !__INTEL_COMPILER
 #include "win32.h"
@@ -27,11 +30,58 @@ along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
 
 #include "libretro.h"
 #include "vectrexia.h"
+#include "ppm.h"
+#include "governor.h"
+#include "ring.h"
+#include "frameskip.h"
 
 constexpr int CYCLES_PER_FRAME = 30000;
+constexpr uint64_t CPU_CLOCK = 1500000;
+constexpr uint64_t MAX_AUDIO_SAMPLE_RATE = 96000;
+// enough for the longest frame, a frame synced frame can run for up to twice the fixed budget
+constexpr size_t MAX_AUDIO_SAMPLES = (2 * CYCLES_PER_FRAME + 64) * MAX_AUDIO_SAMPLE_RATE / CPU_CLOCK + 1;
+unsigned audio_sample_rate = 44100;
+// the samples the frontend has not taken yet, interleaved stereo, room for a couple of the longest frames
+vxl::spsc_ring<int16_t> audio_ring(MAX_AUDIO_SAMPLES * 2 * 2);
+// how full the frontend says its audio buffer is in percent, -1 if it does not say, and the level to keep it at
+int audio_occupancy = -1;
+constexpr int AUDIO_TARGET_OCCUPANCY = 50;
+// the frontend expects to run out of samples soon
+bool audio_underrun_likely = false;
+// the most the sample rate is adjusted by to move the frontend's buffer towards the target
+constexpr double MAX_AUDIO_RATE_ADJUST = 0.005;
+
+// Called by the frontend before each retro_run with how full its audio buffer is
+static void audio_buffer_status(bool active, unsigned occupancy, bool underrun_likely)
+{
+    audio_occupancy = active ? static_cast<int>(occupancy) : -1;
+    audio_underrun_likely = active && underrun_likely;
+}
+
 unsigned long cycles_per_frame = CYCLES_PER_FRAME;
+bool frame_sync = false;
+bool debug_overlay = false;
+
+frameskip_t frameskip{};
+frameskip_t frameskip_fastforward{3, 4};
+unsigned frame_counter = 0;
+bool can_dupe = false;
+bool frame_presented = false;
+int output_scale = 1;
+int supersample = 1;
+// drops the render quality below the settings picked when drawing and converting a frame goes over budget
+QualityGovernor governor;
+std::chrono::steady_clock::time_point render_start, render_end;
+bool av_info_sent = false;
+retro_pixel_format pixel_format = RETRO_PIXEL_FORMAT_RGB565;
 std::unique_ptr<Vectrex> vectrex = std::make_unique<Vectrex>();
-vxgfx::framebuffer<FRAME_WIDTH, FRAME_HEIGHT, vxgfx::pf_rgb565_t> out_buffer{};
+// only the buffer for the pixel format in use is allocated
+vxgfx::dynamic_framebuffer<vxgfx::pf_rgb565_t> out_buffer_rgb565{};
+vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> out_buffer_xrgb8888{};
+// the colour overlay of the cartridge, if there is one, and its tint map at the output resolution
+vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> overlay_image{};
+vxgfx::tint_map overlay_tint{};
+bool colour_overlay = true;
 
 // Callbacks
 static retro_log_printf_t log_cb;
@@ -46,6 +96,34 @@ unsigned retro_api_version(void) { return RETRO_API_VERSION; }
 
 static void update_variables(void);
 
+// Load the colour overlay for a ROM, <system>/vectrexia/overlays/<name>.ppm or <rom path without extension>.ppm
+static void load_overlay(const std::string &rom_path)
+{
+    const auto slash = rom_path.find_last_of("/\\");
+    const auto dot = rom_path.find_last_of('.');
+    const auto stem = rom_path.substr(0, dot != std::string::npos && (slash == std::string::npos || dot > slash)
+                                         ? dot : std::string::npos);
+    const auto name = stem.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    std::string candidates[2];
+    const char *system_dir = nullptr;
+    if (environ_cb(RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, &system_dir) && system_dir)
+        candidates[0] = std::string(system_dir) + "/vectrexia/overlays/" + name + ".ppm";
+    candidates[1] = stem + ".ppm";
+
+    overlay_tint.resize(0, 0);
+    for (const auto &filename : candidates)
+    {
+        if (!filename.empty() && vxgfx::load_ppm(filename, overlay_image))
+        {
+            if (log_cb)
+                log_cb(RETRO_LOG_INFO, "[vectrexia]: Loaded overlay %s (%dx%d).\n", filename.c_str(),
+                       overlay_image.width, overlay_image.height);
+            return;
+        }
+    }
+}
+
 // Cheats
 void retro_cheat_reset(void) {}
 void retro_cheat_set(unsigned index, bool enabled, const char *code) {}
@@ -84,9 +162,24 @@ bool retro_load_game(const struct retro_game_info *info)
 
     environ_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
 
+    // the frontend reports how full its audio buffer is, the sample rate is adjusted to keep it near the target
+    struct retro_audio_buffer_status_callback buffer_status = { audio_buffer_status };
+    if (!environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, &buffer_status))
+    {
+        audio_occupancy = -1;
+        audio_underrun_likely = false;
+    }
+
+    // skipped frames are sent as dupes if the frontend supports it
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe))
+        can_dupe = false;
+
     // Reset the Vectrex, clears the cart ROM and loads the System ROM
     vectrex->Reset();
 
+    if (info && info->path)
+        load_overlay(info->path);
+
     if (info && info->data) { // ensure there is ROM data
         return vectrex->LoadCartridge((const uint8_t*)info->data, info->size);
     }
@@ -97,7 +190,13 @@ bool retro_load_game(const struct retro_game_info *info)
 bool retro_load_game_special(unsigned game_type, const struct retro_game_info *info, size_t num_info) { return false; }
 
 // Unload the cartridge
-void retro_unload_game(void) { vectrex->UnloadCartridge(); }
+void retro_unload_game(void)
+{
+    vectrex->UnloadCartridge();
+    audio_ring.clear();
+    overlay_image.resize(0, 0);
+    overlay_tint.resize(0, 0);
+}
 
 unsigned retro_get_region(void) { return RETRO_REGION_PAL; }
 
@@ -121,6 +220,18 @@ void retro_set_environment(retro_environment_t cb) {
   environ_cb = cb;
 
   struct retro_variable variables[] = {
+      { "vectrexia_resolution", "Resolution; 330x410|660x820|990x1230|1320x1640" },
+      { "vectrexia_supersample", "Supersampling; disabled|2x|4x" },
+      { "vectrexia_glow", "Phosphor glow; disabled|low|high" },
+      { "vectrexia_antialias", "Antialiased lines; disabled|enabled" },
+      { "vectrexia_render_budget", "Render time budget; disabled|2 ms|4 ms|6 ms|8 ms|12 ms" },
+      { "vectrexia_colour_overlay", "Colour overlay; enabled|disabled" },
+      { "vectrexia_sample_rate", "Audio sample rate; 44100 Hz|48000 Hz|96000 Hz" },
+      { "vectrexia_pixel_format", "Pixel format (restart); RGB565|XRGB8888" },
+      { "vectrexia_frame_sync", "Sync frames to the game; disabled|enabled" },
+      { "vectrexia_frameskip", "Frame skip; disabled|1 of 2|2 of 3|3 of 4" },
+      { "vectrexia_frameskip_fastforward", "Frame skip when fast-forwarding; 3 of 4|disabled|1 of 2|2 of 3|7 of 8" },
+      { "vectrexia_debug_overlay", "Debug overlay; disabled|enabled" },
 #ifdef VECTREXIA_DEBUG
       { "vectrexia_internal_slowdown", "Internal Slowdown; 1x|2x|5x|10x|20x|50x|100x|1000x|10000x|30000x" },
 #endif
@@ -132,7 +243,7 @@ void retro_set_environment(retro_environment_t cb) {
   cb(RETRO_ENVIRONMENT_SET_VARIABLES, variables);
 }
 
-void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb) {}
+void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb) { audio_batch_cb = cb; }
 void retro_set_video_refresh(retro_video_refresh_t cb) { video_cb = cb; }
 void retro_set_audio_sample(retro_audio_sample_t cb) { audio_cb = cb; }
 void retro_set_input_poll(retro_input_poll_t cb) { input_poll_cb = cb; }
@@ -172,27 +283,35 @@ void retro_get_system_info(struct retro_system_info *info)
  * Tell libretro about the AV system; the fps, sound sample rate and the
  * resolution of the display.
  */
-void retro_get_system_av_info(struct retro_system_av_info *info) {
-
-    int pixel_format = RETRO_PIXEL_FORMAT_RGB565;
-
+static void fill_av_info(struct retro_system_av_info *info) {
     memset(info, 0, sizeof(retro_system_av_info));
     info->timing.fps            = 50.0;
-    info->timing.sample_rate    = 44100.0;
-    info->geometry.base_width   = FRAME_WIDTH;
-    info->geometry.base_height  = FRAME_HEIGHT;
-    info->geometry.max_width    = FRAME_WIDTH;
-    info->geometry.max_height   = FRAME_HEIGHT;
+    info->timing.sample_rate    = audio_sample_rate;
+    info->geometry.base_width   = FRAME_WIDTH * output_scale;
+    info->geometry.base_height  = FRAME_HEIGHT * output_scale;
+    info->geometry.max_width    = FRAME_WIDTH * MAX_OUTPUT_SCALE;
+    info->geometry.max_height   = FRAME_HEIGHT * MAX_OUTPUT_SCALE;
     //info->geometry.aspect_ratio = 330.0f / 410.0f;
+}
 
-    // the performance level is guide to frontend to give an idea of how intensive this core is to run
-    environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixel_format);
+void retro_get_system_av_info(struct retro_system_av_info *info) {
+
+    fill_av_info(info);
+
+    // fallback to RGB565 if the frontend does not support XRGB8888
+    if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixel_format)) {
+        pixel_format = RETRO_PIXEL_FORMAT_RGB565;
+        environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixel_format);
+    }
+    av_info_sent = true;
 }
 
 // Reset the Vectrex
 void retro_reset(void)
 {
     vectrex->Reset();
+    // the samples from before the reset are not sent
+    audio_ring.clear();
 }
 
 // Test the user input and return the state of the joysticks and buttons
@@ -223,7 +342,118 @@ void get_joystick_state(unsigned port, uint8_t &x, uint8_t &y, uint8_t &b1, uint
     b4 = (unsigned char) (input_state_cb(port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y ) ? 1 : 0);
 }
 
-static const auto green = vxgfx::pf_argb_t(255, 255, 0, 128 );
+static const auto green = vxgfx::pf_argb_t(0xc0, 0x00, 0xff, 0x00);
+
+static const char *glow_names[] = { "off", "low", "high" };
+
+// Render with the settings picked by the governor
+static void apply_quality(void)
+{
+    const auto &q = governor.current();
+    vectrex->SetResolution(output_scale, q.supersample);
+    vectrex->SetGlow(q.glow);
+    vectrex->SetAntialias(q.antialias);
+}
+
+// Give the governor the time the last frame took to draw and convert, and follow its decision
+static void update_quality(void)
+{
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(render_end - render_start).count();
+    // the smoothed time that led to the decision, the governor starts over after a change
+    const auto average = governor.average();
+    if (!governor.Update(us))
+        return;
+
+    apply_quality();
+    if (log_cb)
+    {
+        const auto &q = governor.current();
+        log_cb(RETRO_LOG_INFO, "[vectrexia]: Render time %.2fms, quality level %u: supersample %dx, glow %s, "
+                               "antialiasing %s.\n", average / 1000.0, (unsigned) governor.level(), q.supersample,
+               glow_names[q.glow], q.antialias ? "on" : "off");
+    }
+}
+
+// Convert the vector buffer to the frontend's pixel format and present it, only the areas of the
+// vector buffer that changed are converted. The overlay, if any, is blended on top in the same pass.
+template<typename Pf>
+static void present(vxgfx::dynamic_framebuffer<Pf> &out, const VectorBuffer &fb, const vxgfx::dirty_region &region,
+                    const DebugBuffer *overlay = nullptr)
+{
+    static const vxgfx::mono_lut<Pf> lut{};
+
+    bool full = false;
+    if (out.width != fb.width || out.height != fb.height)
+    {
+        out.resize(fb.width, fb.height);
+        full = true;
+    }
+
+    // the tint map is built once for each output resolution
+    const bool tinted = colour_overlay && overlay_image.width > 0;
+    if (tinted && (overlay_tint.width != fb.width || overlay_tint.height != fb.height))
+    {
+        overlay_tint.build(overlay_image, fb.width, fb.height);
+        full = true;
+    }
+
+    auto convert = [&](const vxgfx::rect_t &r) {
+        if (tinted && overlay)
+            vxgfx::convert_mono(out, fb, overlay_tint, *overlay, r);
+        else if (tinted)
+            vxgfx::convert_mono(out, fb, overlay_tint, r);
+        else if (overlay)
+            vxgfx::convert_mono(out, fb, lut, *overlay, r);
+        else
+            vxgfx::convert_mono(out, fb, lut, r);
+    };
+
+    if (full)
+    {
+        convert(out.rect());
+    }
+    else
+    {
+        for (const auto &r : region)
+            convert(r);
+    }
+
+    render_end = std::chrono::steady_clock::now();
+    video_cb(out.data(), out.width, out.height, sizeof(Pf) * out.width);
+    frame_presented = true;
+}
+
+// Move the samples from the PSG to the ring and on to the frontend, what it does not take is sent with the next frame
+static void send_audio()
+{
+    size_t span;
+    for (;;)
+    {
+        int16_t *dst = audio_ring.write_span(span);
+        auto frames = vectrex->psg_->FillBuffer(dst, span / 2);
+        if (!frames)
+            break;
+        audio_ring.commit(frames * 2);
+    }
+
+    for (;;)
+    {
+        const int16_t *src = audio_ring.read_span(span);
+        if (span < 2)
+            break;
+        auto sent = std::min(audio_batch_cb(src, span / 2), span / 2);
+        audio_ring.consume(sent * 2);
+        if (sent < span / 2)
+            break;
+    }
+}
+
+// Show the last frame again, without converting it
+template<typename Pf>
+static void dupe(const vxgfx::dynamic_framebuffer<Pf> &out)
+{
+    video_cb(can_dupe ? nullptr : out.data(), out.width, out.height, sizeof(Pf) * out.width);
+}
 
 // Run a single frames with out Vectrex emulation.
 void retro_run(void)
@@ -250,52 +480,210 @@ void retro_run(void)
     vectrex->psg_->channel_c_on = !input_state_cb(0, RETRO_DEVICE_KEYBOARD, 0, RETROK_3);
 
     // Vectrex CPU is 1.5MHz (1500000) and at 50 fps, a frame lasts 20ms, therefore in every frame 30,000 cycles happen.
-    auto cycles_run = vectrex->Run(cycles_per_frame);
+    // With frame sync, the frame ends when the game starts drawing its next frame. Games that do not sync (or have
+    // stopped syncing) run for the fixed number of cycles.
+    uint64_t cycles_run;
+    if (frame_sync)
+        cycles_run = vectrex->RunFrame(vectrex->FrameSynced() ? cycles_per_frame * 2 : cycles_per_frame);
+    else
+        cycles_run = vectrex->Run(cycles_per_frame);
+
+    // the number of samples follows the cycles run (882 samples for 30,000 cycles at 44.1kHz), a little more or
+    // less when the frontend's buffer is away from the target, and as many more as allowed when it is about to run out
+    if (audio_underrun_likely)
+        vectrex->psg_->SetRateAdjust(1.0 + MAX_AUDIO_RATE_ADJUST);
+    else if (audio_occupancy >= 0)
+        vectrex->psg_->SetRateAdjust(1.0 + MAX_AUDIO_RATE_ADJUST * (AUDIO_TARGET_OCCUPANCY - audio_occupancy) /
+                                           AUDIO_TARGET_OCCUPANCY);
+    vectrex->psg_->EndFrame(vectrex->cycles);
+    send_audio();
+
+    // the vectors still fade in skipped frames, only the drawing and conversion is skipped
+    bool fastforward = false;
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_FASTFORWARDING, &fastforward))
+        fastforward = false;
+    const auto &skip = fastforward ? frameskip_fastforward : frameskip;
+    if (frame_presented && skip.skipped(frame_counter++))
+    {
+        vectrex->SkipFrame();
+        if (pixel_format == RETRO_PIXEL_FORMAT_XRGB8888)
+            dupe(out_buffer_xrgb8888);
+        else
+            dupe(out_buffer_rgb565);
+        return;
+    }
 
-    // Get buffers
+    render_start = std::chrono::steady_clock::now();
     auto fb = vectrex->getFramebuffer();
+    if (!debug_overlay)
+    {
+        if (pixel_format == RETRO_PIXEL_FORMAT_XRGB8888)
+            present(out_buffer_xrgb8888, *fb, vectrex->getDirtyRegion());
+        else
+            present(out_buffer_rgb565, *fb, vectrex->getDirtyRegion());
+        update_quality();
+        return;
+    }
+
+    // Print sound debugging text, the overlay only covers the tiles drawn to this frame
     auto db = vectrex->getDebugbuffer();
+    db->begin_frame();
+    static const vxgfx::glyph_atlas<vxgfx::pf_argb_t> font{green};
+    char line[64];
+    vxgfx::draw_text(*db, 2, 10, font, vxl::format_to(line, "@ %.fHz", (double)(cycles_run * 50)));
+    vxgfx::draw_text(*db, 2, 20, font, vxl::format_to(line, "Channel A: %3.0fHz (noise: %d)", vectrex->psg_->channel_a.frequency(), vectrex->psg_->channel_a.noise_enabled));
+    vxgfx::draw_text(*db, 2, 30, font, vxl::format_to(line, "Channel B: %3.0fHz (noise: %d)", vectrex->psg_->channel_b.frequency(), vectrex->psg_->channel_b.noise_enabled));
+    vxgfx::draw_text(*db, 2, 40, font, vxl::format_to(line, "Channel C: %3.0fHz (noise: %d)", vectrex->psg_->channel_c.frequency(), vectrex->psg_->channel_c.noise_enabled));
+
+    // the text changes every frame, and where the text was last frame has to be converted again to remove it
+    static vxgfx::dirty_region region{};
+    region = vectrex->getDirtyRegion();
+    db->add_changed(region);
+
+    if (pixel_format == RETRO_PIXEL_FORMAT_XRGB8888)
+        present(out_buffer_xrgb8888, *fb, region, db);
+    else
+        present(out_buffer_rgb565, *fb, region, db);
+    update_quality();
+}
+
 
-    // Print sound debugging text
-    vxgfx::draw_text<vxgfx::m_direct>(*db, 2, 10, green, vxl::format("@ %.fHz", (double)(cycles_run * 50)));
-    vxgfx::draw_text<vxgfx::m_direct>(*db, 2, 20, green, vxl::format("Channel A: %3.0fHz (noise: %d)", vectrex->psg_->channel_a.frequency_, vectrex->psg_->channel_a.noise_enabled));
-    vxgfx::draw_text<vxgfx::m_direct>(*db, 2, 30, green, vxl::format("Channel B: %3.0fHz (noise: %d)", vectrex->psg_->channel_b.frequency_, vectrex->psg_->channel_b.noise_enabled));
-    vxgfx::draw_text<vxgfx::m_direct>(*db, 2, 40, green, vxl::format("Channel C: %3.0fHz (noise: %d)", vectrex->psg_->channel_c.frequency_, vectrex->psg_->channel_c.noise_enabled));
+static void update_variables(void) {
+  struct retro_variable var = {
+      .key   = "vectrexia_resolution",
+      .value = nullptr,
+  };
 
+  int scale = output_scale;
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    // the width is a multiple of the native width, eg. 660x820 is 2x
+    auto width = strtoul(var.value, nullptr, 10);
+    scale = vxl::clamp(static_cast<int>(width / FRAME_WIDTH), 1, MAX_OUTPUT_SCALE);
+  }
 
-    // Define the pf_mono_t => pf_rgb565_t transform
-    auto mono_to_rgb565 = [](const vxgfx::pf_mono_t &p) {
-        return vxgfx::pf_rgb565_t(static_cast<uint8_t>(0xff * p.value),
-                                  static_cast<uint8_t>(0xff * p.value),
-                                  static_cast<uint8_t>(0xff * p.value));
-    };
+  var.key = "vectrexia_supersample";
+  int factor = supersample;
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    // "disabled" is parsed as 0
+    factor = std::max<int>(strtoul(var.value, nullptr, 10), 1);
+  }
+  factor = std::min(factor, MAX_RENDER_SCALE / scale);
+
+  if (scale != output_scale || factor != supersample) {
+    bool resized = scale != output_scale;
+    output_scale = scale;
+    supersample = factor;
+
+    // the frontend learns the initial geometry from retro_get_system_av_info
+    if (resized && av_info_sent) {
+      struct retro_game_geometry geometry = {
+          .base_width  = static_cast<unsigned>(FRAME_WIDTH * output_scale),
+          .base_height = static_cast<unsigned>(FRAME_HEIGHT * output_scale),
+          .max_width   = FRAME_WIDTH * MAX_OUTPUT_SCALE,
+          .max_height  = FRAME_HEIGHT * MAX_OUTPUT_SCALE,
+          // 0 is base_width / base_height, the pixels are square
+          .aspect_ratio = 0.0f,
+      };
+      environ_cb(RETRO_ENVIRONMENT_SET_GEOMETRY, &geometry);
+    }
+
+    if (log_cb)
+      log_cb(RETRO_LOG_INFO, "[vectrexia]: Output resolution %dx%d (supersample %dx).\n",
+             FRAME_WIDTH * output_scale, FRAME_HEIGHT * output_scale, supersample);
+  }
+
+  var.key = "vectrexia_glow";
+  render_quality_t quality = {};
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    if (strcmp(var.value, "high") == 0)
+      quality.glow = GLOW_HIGH;
+    else if (strcmp(var.value, "low") == 0)
+      quality.glow = GLOW_LOW;
+  }
 
-    // fb => out_buffer transform
-    std::transform(fb->begin(), fb->end(), out_buffer.begin(), mono_to_rgb565);
+  var.key = "vectrexia_antialias";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    quality.antialias = strcmp(var.value, "enabled") == 0;
+  }
 
-    // TODO
-    // some blending of db on top of out_buffer
+  // the settings picked are the best the governor will use
+  quality.supersample = supersample;
+  governor.SetMaximum(quality);
 
-    // 882 audio samples per frame (44.1kHz @ 50 fps)
-    uint8_t buffer[882];
-    vectrex->psg_->FillBuffer(buffer, sizeof(buffer));
+  var.key = "vectrexia_render_budget";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    // "disabled" is parsed as 0
+    governor.SetBudget(strtoul(var.value, nullptr, 10) * 1000);
+  }
+  apply_quality();
 
-    for (unsigned char i : buffer) {
-        auto convs = static_cast<short>((i << 8u) - 0x7ffu);
-        // mono sound, same data for both channels
-        audio_cb(convs, convs);
+  var.key = "vectrexia_colour_overlay";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    bool enabled = strcmp(var.value, "enabled") == 0;
+    // switching between tinted and grayscale output needs a full conversion
+    if (enabled != colour_overlay) {
+      out_buffer_rgb565.resize(0, 0);
+      out_buffer_xrgb8888.resize(0, 0);
     }
-    
-    video_cb(reinterpret_cast<const uint16_t*>(out_buffer.data()),
-        FRAME_WIDTH, FRAME_HEIGHT, sizeof(unsigned short) * FRAME_WIDTH);
-}
+    colour_overlay = enabled;
+  }
 
+  var.key = "vectrexia_sample_rate";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    auto rate = static_cast<unsigned>(vxl::clamp<unsigned long>(strtoul(var.value, nullptr, 10), 8000,
+                                                                 MAX_AUDIO_SAMPLE_RATE));
+    if (rate != audio_sample_rate) {
+      audio_sample_rate = rate;
+      vectrex->psg_->SetSampleRate(audio_sample_rate);
+      // the samples still waiting were made for the old rate
+      audio_ring.clear();
+
+      // the frontend has to reinitialise its audio for a new rate
+      if (av_info_sent) {
+        struct retro_system_av_info info;
+        fill_av_info(&info);
+        environ_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &info);
+      }
+
+      if (log_cb)
+        log_cb(RETRO_LOG_INFO, "[vectrexia]: Audio sample rate %u Hz.\n", audio_sample_rate);
+    }
+  }
+
+  // the pixel format is only sent to the frontend when the game is loaded
+  var.key = "vectrexia_pixel_format";
+  if (!av_info_sent && environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    pixel_format = (strcmp(var.value, "XRGB8888") == 0) ? RETRO_PIXEL_FORMAT_XRGB8888 : RETRO_PIXEL_FORMAT_RGB565;
+  }
+
+  var.key = "vectrexia_frameskip";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    frameskip = parse_frameskip(var.value);
+  }
+
+  var.key = "vectrexia_frameskip_fastforward";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    frameskip_fastforward = parse_frameskip(var.value);
+  }
+
+  var.key = "vectrexia_frame_sync";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    frame_sync = strcmp(var.value, "enabled") == 0;
+  }
+
+  var.key = "vectrexia_debug_overlay";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+    bool enabled = strcmp(var.value, "enabled") == 0;
+    // the text left in the output when the overlay is turned off is removed by a full conversion
+    if (debug_overlay && !enabled) {
+      out_buffer_rgb565.resize(0, 0);
+      out_buffer_xrgb8888.resize(0, 0);
+    }
+    debug_overlay = enabled;
+  }
 
-static void update_variables(void) {
 #ifdef VECTREXIA_DEBUG
-  struct retro_variable var = {
-      .key = "vectrexia_internal_slowdown",
-  };
+  var.key = "vectrexia_internal_slowdown";
 
   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
     char str[100];
@@ -891,6 +891,20 @@ enum retro_mod
  * It can be used by the core for localization purposes.
  */
 
+#define RETRO_ENVIRONMENT_GET_FASTFORWARDING (49 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+/* bool * --
+ * Boolean value that indicates whether or not the frontend is in
+ * fastforwarding mode.
+ */
+
+#define RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK 62
+/* const struct retro_audio_buffer_status_callback * --
+ * Lets the core know how full the frontend's audio buffer is, once
+ * per frame before retro_run(). The core can use it to make more or
+ * fewer samples and keep the buffer away from underruns. A NULL
+ * callback disables it.
+ */
+
 #define RETRO_MEMDESC_CONST     (1 << 0)   /* The frontend will never change this memory area once retro_load_game has returned. */
 #define RETRO_MEMDESC_BIGENDIAN (1 << 1)   /* The memory area contains big endian data. Default is little endian. */
 #define RETRO_MEMDESC_ALIGN_2   (1 << 16)  /* All memory access in this area is aligned to their own size, or 2, whichever is smaller. */
@@ -1446,6 +1460,16 @@ struct retro_audio_callback
     retro_audio_set_state_callback_t set_state;
 };
 
+/* Notifies the core of the state of the frontend's audio buffer.
+ * active: false if the frontend's audio is paused or disabled.
+ * occupancy: how full the buffer is, 0 to 100 percent.
+ * underrun_likely: the frontend expects the buffer to underrun soon. */
+typedef void (*retro_audio_buffer_status_callback_t)(bool active, unsigned occupancy, bool underrun_likely);
+struct retro_audio_buffer_status_callback
+{
+    retro_audio_buffer_status_callback_t callback;
+};
+
 /* Notifies a libretro core of time spent since last invocation 
  * of retro_run() in microseconds.
  *
@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ppm.h"
+#include <cstdio>
+#include <cctype>
+#include <vector>
+
+namespace vxgfx {
+
+// Read the next number of the header, skipping white space and comments
+static bool read_header_value(FILE *file, int &value)
+{
+    int c = fgetc(file);
+    while (c != EOF && (isspace(c) || c == '#')) {
+        if (c == '#') {
+            while (c != EOF && c != '\n')
+                c = fgetc(file);
+        }
+        c = fgetc(file);
+    }
+
+    value = 0;
+    int digits = 0;
+    while (c != EOF && isdigit(c) && digits < 6) {
+        value = value * 10 + (c - '0');
+        digits++;
+        c = fgetc(file);
+    }
+    // the single white space character after the value is part of the header
+    return digits > 0 && c != EOF && isspace(c);
+}
+
+bool load_ppm(const std::string &filename, dynamic_framebuffer<pf_argb_t> &image)
+{
+    image.resize(0, 0);
+
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file)
+        return false;
+
+    int width = 0, height = 0, max_value = 0;
+    bool ok = fgetc(file) == 'P' && fgetc(file) == '6' &&
+              read_header_value(file, width) && read_header_value(file, height) &&
+              read_header_value(file, max_value) &&
+              width > 0 && height > 0 && max_value > 0 && max_value <= 255;
+
+    std::vector<uint8_t> rgb;
+    if (ok) {
+        rgb.resize(static_cast<size_t>(width) * height * 3);
+        ok = fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+    }
+    fclose(file);
+    if (!ok)
+        return false;
+
+    image.resize(width, height);
+    auto raw = image.data();
+    for (size_t i = 0; i < image.size(); i++) {
+        auto c = [&](size_t n) { return static_cast<uint8_t>(rgb[i * 3 + n] * 255u / max_value); };
+        raw[i] = pf_argb_t(c(0), c(1), c(2));
+    }
+    return true;
+}
+
+}
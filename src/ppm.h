@@ -0,0 +1,35 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VECTREXIA_PPM_H
+#define VECTREXIA_PPM_H
+
+#include <string>
+#include "gfxutil.h"
+
+namespace vxgfx {
+
+/*
+ * Load a binary (P6) PPM image, eg. a cartridge overlay. Returns false if the file cannot be read or is not
+ * a PPM with a maximum value of 255 or less, image is left empty in that case.
+ */
+bool load_ppm(const std::string &filename, dynamic_framebuffer<pf_argb_t> &image);
+
+}
+
+#endif //VECTREXIA_PPM_H
@@ -0,0 +1,154 @@
+/*
+Copyright (C) 2016 beardypig
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VECTREXIA_RING_H
+#define VECTREXIA_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace vxl
+{
+
+/*
+ * Single producer, single consumer ring buffer
+ *
+ * One thread writes and another (or the same one) reads without any locks. Each side only stores its own position,
+ * with release ordering, and loads the other side's with acquire ordering, so the data written before a position
+ * is published is visible to the other side. The positions count up without wrapping and the capacity is a power
+ * of two, so the number of items is always head - tail.
+ *
+ * The spans give direct access to the contiguous part of the free or filled space, so data can be produced in to
+ * or consumed from the ring without an extra copy.
+ */
+template<typename T>
+class spsc_ring
+{
+    static_assert(std::is_trivially_copyable<T>::value, "the ring copies items with memcpy");
+
+    std::vector<T> buffer_;
+    size_t mask_;
+    // written by the producer and the consumer, on separate cache lines so they do not contend
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+
+public:
+    // the capacity is rounded up to a power of two
+    explicit spsc_ring(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring &operator=(const spsc_ring&) = delete;
+
+    size_t capacity() const
+    {
+        return buffer_.size();
+    }
+
+    // Number of items that can be read, only exact on the consumer side
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    // Producer: the contiguous free space, count is set to the number of items that can be written there
+    T *write_span(size_t &count)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t free = capacity() - (head - tail_.load(std::memory_order_acquire));
+        count = std::min(free, capacity() - (head & mask_));
+        return &buffer_[head & mask_];
+    }
+
+    // Producer: publish count items written to the write span
+    void commit(size_t count)
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Consumer: the contiguous filled space, count is set to the number of items that can be read there
+    const T *read_span(size_t &count) const
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t filled = head_.load(std::memory_order_acquire) - tail;
+        count = std::min(filled, capacity() - (tail & mask_));
+        return &buffer_[tail & mask_];
+    }
+
+    // Consumer: release count items read from the read span
+    void consume(size_t count)
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Consumer: drop everything in the ring
+    void clear()
+    {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // Producer: copy up to count items in to the ring, returns the number written
+    size_t write(const T *data, size_t count)
+    {
+        size_t written = 0;
+        while (written < count)
+        {
+            size_t span;
+            T *dst = write_span(span);
+            span = std::min(span, count - written);
+            if (!span)
+                break;
+            std::memcpy(dst, data + written, span * sizeof(T));
+            commit(span);
+            written += span;
+        }
+        return written;
+    }
+
+    // Consumer: copy up to count items out of the ring, returns the number read
+    size_t read(T *data, size_t count)
+    {
+        size_t done = 0;
+        while (done < count)
+        {
+            size_t span;
+            const T *src = read_span(span);
+            span = std::min(span, count - done);
+            if (!span)
+                break;
+            std::memcpy(data + done, src, span * sizeof(T));
+            consume(span);
+            done += span;
+        }
+        return done;
+    }
+};
+
+}
+
+#endif //VECTREXIA_RING_H
@@ -21,22 +21,20 @@ along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdint.h>
 #include <vector>
-#include <functional>
 #include <algorithm>
 
-using update_callback_t = std::function<void(uint64_t)>;
-
 class TimerUtil
 {
 public:
     static inline uint64_t cycles_to_nanos(uint64_t cycles)
     {
-        return (uint64_t) (cycles * (1 / 1.5e-3));
+        // 1.5 MHz clock, 2000/3 ns per cycle
+        return cycles * 2000 / 3;
     }
 
     static inline uint64_t nanos_to_cycles(uint64_t nanos)
     {
-        return (uint64_t) (nanos / (1 / 1.5e-3));
+        return nanos * 3 / 2000;
     }
 };
 
@@ -78,49 +76,53 @@ public:
     }
 };
 
-class CallbackTimer
+// Delivers queued values after a delay in nanoseconds. The values are stored by value, so once the queue has
+// grown to its working size enqueue() does not allocate
+template<typename T>
+class SignalTimer
 {
     struct data
     {
         uint64_t cycles, remaining_nanos;
-        update_callback_t callback;
-
-        bool operator== (const uint64_t &count)
-        {
-            if (cycles <= count)
-            {
-                callback(remaining_nanos);
-                return true;
-            }
-            return false;
-        }
+        T value;
     };
 
     std::vector<data> items;
 public:
-    // enqueue and item to be updated at a later time
-    void enqueue(uint64_t current_cycle, uint64_t nanosecond, update_callback_t callback)
+    // enqueue a value to be delivered at a later time
+    void enqueue(uint64_t current_cycle, uint64_t nanosecond, const T &value)
     {
-        // eg. 7800e-9 / (1/1.5e6) == 7800e-3 / (1/1.5) == 7800 / (1/1.5e-3)
         uint64_t cycles = TimerUtil::nanos_to_cycles(nanosecond);
         uint64_t remainder = nanosecond - TimerUtil::cycles_to_nanos(cycles);
-        //printf("A delay of %lldns causes a delay of %lld cycles, with an extra delay of %lldns\n",
-        //       nanosecond, cycles, remainder);
-        items.push_back({ current_cycle + cycles, remainder, callback });
-
-        //printf("Callback queue length: %d\n", items.size());
+        items.push_back({ current_cycle + cycles, remainder, value });
     }
-    void tick(uint64_t cycles)
+    // call fn(value, remaining_nanos) for every value that is due, in the order they were queued
+    template<typename Fn>
+    void tick(uint64_t cycles, Fn &&fn)
     {
-        // https://en.wikipedia.org/wiki/Erase%E2%80%93remove_idiom
-        items.erase(std::remove(items.begin(), items.end(), cycles), items.end());
+        auto due = [cycles](const data &d) { return d.cycles <= cycles; };
+        auto first = std::find_if(items.begin(), items.end(), due);
+        if (first == items.end())
+            return;
+
+        auto out = first;
+        for (auto it = first; it != items.end(); ++it)
+        {
+            if (due(*it))
+                fn(it->value, it->remaining_nanos);
+            else
+                *out++ = std::move(*it);
+        }
+        items.erase(out, items.end());
     }
     void clear()
     {
         items.clear();
     }
-
+    size_t capacity() const
+    {
+        return items.capacity();
+    }
 };
 
-
 #endif //VECTREXIA_UPDATETIMER_H
@@ -21,9 +21,11 @@ along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
 #define VECTREXIA_VECLIB_H
 
 #include <string>
+#include <string_view>
 #include <cstdio>
 #include <cstdarg>
 #include <cassert>
+#include <algorithm>
 
 /*
  * Name space for vectrexia utility functions
@@ -65,6 +67,23 @@ inline std::string format(const char *fmt, ...)
     return out;
 }
 
+/*
+ * printf style formatting in to a fixed buffer, does not allocate. The output is truncated to fit the buffer,
+ * the returned view is valid for as long as the buffer is.
+ */
+template<size_t N>
+inline std::string_view format_to(char (&buffer)[N], const char *fmt, ...)
+{
+    static_assert(N > 0, "the buffer needs room for the terminator");
+    va_list ap;
+    va_start(ap, fmt);
+    int size = vsnprintf(buffer, N, fmt, ap);
+    va_end(ap);
+    if (size < 0)
+        size = 0;
+    return std::string_view(buffer, std::min<size_t>(static_cast<size_t>(size), N - 1));
+}
+
 }
 
 
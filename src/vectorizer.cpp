@@ -5,6 +5,13 @@
 #include <inttypes.h>
 #include "vectorizer.h"
 
+Vectorizer::Vectorizer()
+{
+    // two vectors are recorded per cycle, reserve enough for a 30000 cycle frame and the vectors that
+    // are still fading out from the previous frame
+    vectors_.reserve(2 * (30000 + decay_cycles));
+}
+
 void Vectorizer::Step(uint8_t porta, uint8_t portb, uint8_t zero_, uint8_t blank_)
 {
     // porta is connected to the databus of the sound chip and DAC
@@ -21,11 +28,13 @@ void Vectorizer::Step(uint8_t porta, uint8_t portb, uint8_t zero_, uint8_t blank
 
     blank = blank_;
 
-    signal_queue.tick(cycles);
+    signal_queue.tick(cycles, [this](const signals_t &signals, uint64_t remaining_nanos) {
+        UpdateSignals(signals.ramp, signals.zero, signals.integrators, remaining_nanos);
+    });
 
     // sample x is always set
-    float sample_v = dac(porta);
-    float ref_0 = 0.0f;
+    int32_t sample_v = dac(porta);
+    int32_t ref_0 = 0;
 
     // DAC sample is between -2.5, +2.5
     sample_x = sample_v;
@@ -41,8 +50,9 @@ void Vectorizer::Step(uint8_t porta, uint8_t portb, uint8_t zero_, uint8_t blank
                 ref_0 = sample_v * 2;
                 break;
             case 2: // Z Axis (brightness) Sample and Hold
-                sample_z = std::max(0.0f, -sample_v * 2); // clamp to [0, 5]
+                sample_z = std::max(0, -sample_v * 2); // clamp to [0, 5]
                 break;
+            case 3: // Sound output, mixed in to the PSG output
             default:
                 break;
         }
@@ -53,17 +63,13 @@ void Vectorizer::Step(uint8_t porta, uint8_t portb, uint8_t zero_, uint8_t blank
 
     uint8_t ramp_ = (uint8_t)portb >> 7;
     // update RAMP and integrators in 7800ns
-    signal_queue.enqueue(cycles,
-                         signal_delay,
-                         [this, ramp_, zero_, new_integrator_x, new_integrator_y](uint64_t n){
-                             UpdateSignals(ramp_, zero_, {new_integrator_x, new_integrator_y}, n);
-                         });
+    signal_queue.enqueue(cycles, signal_delay, {ramp_, zero_, {new_integrator_x, new_integrator_y}});
 
 #ifdef VECTORIZER_DEBUG
-    min_x = std::min(axes.x, min_x);
-    max_x = std::max(axes.x, max_x);
-    min_y = std::min(axes.y, min_y);
-    max_y = std::max(axes.y, max_y);
+    min_x = std::min(axes.volts_x(), min_x);
+    max_x = std::max(axes.volts_x(), max_x);
+    min_y = std::min(axes.volts_y(), min_y);
+    max_y = std::max(axes.volts_y(), max_y);
 #endif
 
     cycles++;
@@ -71,26 +77,28 @@ void Vectorizer::Step(uint8_t porta, uint8_t portb, uint8_t zero_, uint8_t blank
 
 void Vectorizer::UpdateSignals(uint8_t ramp_, uint8_t zero_, const integrators_t &integrators_, uint64_t remaining_nanos)
 {
-    float ramp_time_old = 0.0f;
-    float ramp_time_new = 0.0f;
+    // the signals change part way through a cycle, the remainder is converted to ticks (1/1000th of a cycle)
+    const int64_t remaining = std::min<int64_t>(remaining_nanos * 3 / 2, TICKS_PER_CYCLE);
+    int64_t ramp_time_old = 0;
+    int64_t ramp_time_new = 0;
 
     if (!ramp_ && ramp) // ramp turning on
     {
         // the change is delayed, so the ramp time will only be what time is left from
         // the current cycle ie. the remainder time
-        ramp_time_new = (float)(time_per_clock - (remaining_nanos / 1.0e9));
+        ramp_time_new = TICKS_PER_CYCLE - remaining;
     }
     else if (ramp_ && !ramp) // ramp turning off
     {
         // when turning off, there is still a partial cycles amount of time to run for...
-        ramp_time_old = (float)(remaining_nanos / 1.0e9);
+        ramp_time_old = remaining;
     }
     else if (!ramp_ && !ramp) // still active
     {
         // if the integrators have changed, then you need one vector for the first part of the cycles
         // and another for the second part of the cycle
-        ramp_time_old = (float) (remaining_nanos / 1.0e9);
-        ramp_time_new = time_per_clock - ramp_time_old;
+        ramp_time_old = remaining;
+        ramp_time_new = TICKS_PER_CYCLE - ramp_time_old;
     }
 
     if (!zero_)
@@ -101,12 +109,14 @@ void Vectorizer::UpdateSignals(uint8_t ramp_, uint8_t zero_, const integrators_t
     // draw vectors using the OLD integrator value
     axes.integrate(ramp_time_old, integrators);
 
-    vectors_.push_back({axes, blank, ramp, sample_z / 5.0f, cycles});
+    // Z is 0 - 5 V, full intensity at 5 V
+    const int32_t intensity = sample_z * (INTENSITY_ONE / DAC_STEPS_PER_5V);
+    vectors_.push_back({axes, blank, ramp, intensity, cycles, cycles});
 
     // draw vectors using the NEW integrator values
     axes.integrate(ramp_time_new, integrators_);
 
-    vectors_.push_back({axes, blank, ramp_, sample_z / 5.0f, cycles});
+    vectors_.push_back({axes, blank, ramp_, intensity, cycles, cycles});
 
     zero = zero_;
     ramp = ramp_;
@@ -115,62 +125,47 @@ void Vectorizer::UpdateSignals(uint8_t ramp_, uint8_t zero_, const integrators_t
 
 //<editor-fold desc="Drawing Methods">
 
-VectorBuffer *Vectorizer::getVectorBuffer()
+void Vectorizer::CollectVectors()
 {
-    struct line_vector_t
-    {
-        float x0, y0, x1, y1;
-        float intensity0, intensity1;
-        uint64_t cycles0, cycles1;
-        line_vector_t(axes_t pos, float intensity_, uint64_t cycles_)
-        {
-            x0 = x1 = pos.x;
-            y0 = y1 = pos.y;
-            intensity0 = intensity1 = intensity_;
-            cycles0 = cycles1 = cycles_;
-        };
-        line_vector_t(axes_t pos, uint64_t cycles_)
-        {
-            x0 = x1 = pos.x;
-            y0 = y1 = pos.y;
-            intensity0 = intensity1 = 0.0f;
-            cycles0 = cycles1 = cycles_;
-        }
-        void set_end(axes_t pos)
-        {
-            x1 = pos.x;
-            y1 = pos.y;
-        }
-    };
-
-    // start with black
-    vector_buffer.clear();
-
-    std::vector<line_vector_t> to_draw;
-    std::vector<line_vector_t> debug_to_draw;
+    if (collected_cycles == cycles)
+        return;
+    // vectors from this cycle on were recorded since the last collection
+    const uint64_t frame_start = collected_cycles == UINT64_MAX ? 0 : collected_cycles;
+    collected_cycles = cycles;
+
+    to_draw.clear();
+    debug_to_draw.clear();
     bool beam = false;
 
     for (auto vect = vectors_.begin(); vect != vectors_.end(); vect++)
     {
+        if (beam && vect->cycle >= frame_start && to_draw.back().cycles0 < frame_start)
+        {
+            // the beam was on when the last frame was collected, the new part of the line is a separate segment
+            // as it has not faded
+            to_draw.back().set_end(vect->pos, vect->cycle);
+            to_draw.emplace_back(vect->pos, vect->intensity, vect->cycle);
+        }
+
         if (beam)
         {
             if (!vect->blank)
             {
 #ifdef VECTORIZER_DEBUG
-                line_vector_t debug_vect(vect->pos, vect->end_cycle);
+                line_vector_t debug_vect(vect->pos, vect->cycle);
                 debug_to_draw.push_back(debug_vect);
 #endif
                 beam = false;
             }
             // Update line when the beam is on or if it's just turned off (that's the end of the line)
             line_vector_t &new_vect = to_draw.back();
-            new_vect.set_end(vect->pos);
+            new_vect.set_end(vect->pos, vect->cycle);
         }
         else
         {
             if (vect->blank) // beam has just turned on
             {
-                line_vector_t new_vect(vect->pos, vect->intensity, vect->end_cycle);
+                line_vector_t new_vect(vect->pos, vect->intensity, vect->cycle);
                 to_draw.push_back(new_vect);
                 beam = true;
             }
@@ -180,39 +175,81 @@ VectorBuffer *Vectorizer::getVectorBuffer()
                 // extend the debug vector
                 line_vector_t &debug_vect = debug_to_draw.back();
                 // beam may only be on for 1 cycle
-                debug_vect.set_end(vect->pos);
+                debug_vect.set_end(vect->pos, vect->cycle);
 
-                line_vector_t new_debug_vect(vect->pos, vect->intensity, vect->end_cycle);
+                line_vector_t new_debug_vect(vect->pos, vect->intensity, vect->cycle);
                 debug_to_draw.push_back(new_debug_vect);
             }
 #endif
         }
 
         // fade the vector based on how long ago it was drawn
-        vect->intensity -= ((cycles - vect->end_cycle) * (1.0f / decay_cycles));
+        vect->intensity -= (int32_t) ((cycles - vect->end_cycle) * INTENSITY_ONE / decay_cycles);
         vect->end_cycle = cycles;
     }
 
     // remove all the vectors that have 0 intensity or less
     vectors_.erase(std::remove_if(vectors_.begin(), vectors_.end(),
-                                  [](const Vector &v) { return v.intensity <= 0.0f; }), vectors_.end());
+                                  [](const Vector &v) { return v.intensity <= 0; }), vectors_.end());
+}
 
+VectorBuffer *Vectorizer::getVectorBuffer()
+{
+    // start with black, only the areas drawn to in the previous frame need to be cleared
+    auto &target = (supersample > 1) ? render_buffer : vector_buffer;
+    if (redraw_all)
+    {
+        target.clear();
+    }
+    else
+    {
+        for (const auto &r: dirty_prev)
+            target.clear(r);
+    }
+    dirty.clear();
+
+    CollectVectors();
+
+    const auto scale = (int64_t) std::lround(scale_factor * 65536.0f);
     for (const auto &vect: to_draw)
     {
-        if (vect.intensity0 > 0.0f)
+        if (vect.intensity0 > 0)
         {
-            vxgfx::draw_line<vxgfx::m_direct>(vector_buffer, vp,
-                vect.x0 * scale_factor, vect.y0 * scale_factor,
-                vect.x1 * scale_factor, vect.y1 * scale_factor,
-                vxgfx::pf_mono_t{ vect.intensity0 });
+            const vxgfx::pf_mono_t c{ vect.intensity0 * (1.0f / INTENSITY_ONE) };
+            if (antialias)
+            {
+                // the lines are drawn with subpixel end points and cover one more pixel either side
+                auto p0 = translate(vect.p0, scale, target.width, target.height, vxgfx::AA_SUBPIXEL_BITS);
+                auto p1 = translate(vect.p1, scale, target.width, target.height, vxgfx::AA_SUBPIXEL_BITS);
+                vxgfx::draw_aline<vxgfx::m_max>(target, p0.first, p0.second, p1.first, p1.second, c);
+
+                vxgfx::rect_t bounds{
+                    vxgfx::point_t{ (std::min(p0.first, p1.first) >> vxgfx::AA_SUBPIXEL_BITS) - 1,
+                                    (std::min(p0.second, p1.second) >> vxgfx::AA_SUBPIXEL_BITS) - 1 },
+                    vxgfx::point_t{ (std::max(p0.first, p1.first) >> vxgfx::AA_SUBPIXEL_BITS) + 2,
+                                    (std::max(p0.second, p1.second) >> vxgfx::AA_SUBPIXEL_BITS) + 2 }
+                };
+                dirty.add(vxgfx::intersect(bounds, target.rect()));
+                continue;
+            }
+
+            auto p0 = translate(vect.p0, scale, target.width, target.height);
+            auto p1 = translate(vect.p1, scale, target.width, target.height);
+            vxgfx::draw_line<vxgfx::m_direct>(target, p0.first, p0.second, p1.first, p1.second, c);
+
+            vxgfx::rect_t bounds{
+                vxgfx::point_t{ std::min(p0.first, p1.first), std::min(p0.second, p1.second) },
+                vxgfx::point_t{ std::max(p0.first, p1.first) + 1, std::max(p0.second, p1.second) + 1 }
+            };
+            dirty.add(vxgfx::intersect(bounds, target.rect()));
         }
     }
 
 #ifdef VECTORIZER_DEBUG
     for (const auto &debug_vect: debug_to_draw)
     {
-        debug_framebuffer.draw_line(debug_vect.x0 * scale_factor, debug_vect.y0 * scale_factor,
-                                    debug_vect.x1 * scale_factor, debug_vect.y1 * scale_factor,
+        debug_framebuffer.draw_line(debug_vect.p0.volts_x() * scale_factor, debug_vect.p0.volts_y() * scale_factor,
+                                    debug_vect.p1.volts_x() * scale_factor, debug_vect.p1.volts_y() * scale_factor,
                                     color_t{1.0f, 0.0f, 0.0f, DEBUG_LINE_INTENSITY});
     }
 
@@ -242,10 +279,144 @@ VectorBuffer *Vectorizer::getVectorBuffer()
 
 #endif
 
+    // the areas of the output that changed are the ones drawn to in this frame and the previous frame
+    changed.clear();
+    if (redraw_all)
+    {
+        changed.add(vector_buffer.rect());
+    }
+    else
+    {
+        auto to_output = [this](const vxgfx::rect_t &r) {
+            return vxgfx::rect_t{
+                vxgfx::point_t{ r.left / supersample, r.top / supersample },
+                vxgfx::point_t{ (r.right + supersample - 1) / supersample, (r.bottom + supersample - 1) / supersample }
+            };
+        };
+        for (const auto &r: dirty_prev)
+            changed.add(to_output(r));
+        for (const auto &r: dirty)
+            changed.add(to_output(r));
+    }
+
+    if (supersample > 1)
+    {
+        for (const auto &r: changed)
+            vxgfx::downsample_box(vector_buffer, render_buffer, supersample, r);
+    }
+
+    std::swap(dirty, dirty_prev);
+    redraw_all = false;
+
+    // count the containers that grew since the last frame
+    const std::array<size_t, 5> capacities_ = {
+        vectors_.capacity(), to_draw.capacity(), debug_to_draw.capacity(), signal_queue.capacity(),
+        display_list.capacity()
+    };
+    frame_allocations = 0;
+    for (size_t i = 0; i < capacities.size(); i++)
+    {
+        frame_allocations += capacities_[i] > capacities[i];
+    }
+    capacities = capacities_;
+
+    if (glow.enabled())
+    {
+        // the glow spreads out from the changed areas, changed is grown to match
+        glow.Apply(vector_buffer, glow_buffer, changed);
+        return &glow_buffer;
+    }
     return &vector_buffer;
 }
+
+std::pair<int, int> Vectorizer::translate(const axes_t &pos, int64_t scale, int w, int h, int subpixel_bits) const
+{
+    // the viewport bounds are exact in position units
+    const int64_t l = std::llround(vp.l * (double) POSITION_PER_VOLT);
+    const int64_t r = std::llround(vp.r * (double) POSITION_PER_VOLT);
+    const int64_t t = std::llround(vp.t * (double) POSITION_PER_VOLT);
+    const int64_t b = std::llround(vp.b * (double) POSITION_PER_VOLT);
+
+    const int64_t x = (pos.x * scale) >> 16;
+    const int64_t y = (pos.y * scale) >> 16;
+    return std::make_pair((int) ((x - l) * ((int64_t) w << subpixel_bits) / (r - l)),
+                          (int) ((y - t) * ((int64_t) h << subpixel_bits) / (b - t)));
+}
+
+void Vectorizer::SkipFrame()
+{
+    CollectVectors();
+}
+
+const DisplayList &Vectorizer::getDisplayList()
+{
+    CollectVectors();
+
+    display_list.clear();
+    for (const auto &vect: to_draw)
+    {
+        if (vect.intensity0 > 0)
+        {
+            display_list.push_back({vect.p0.volts_x(), vect.p0.volts_y(), vect.p1.volts_x(), vect.p1.volts_y(),
+                                    vect.intensity0 * (1.0f / INTENSITY_ONE), vect.cycles0, vect.cycles1});
+        }
+    }
+    return display_list;
+}
+
 DebugBuffer * Vectorizer::getDebugBuffer()
 {
     return &debug_buffer;
 }
+
+const vxgfx::dirty_region &Vectorizer::getDirtyRegion() const
+{
+    return changed;
+}
+
+int Vectorizer::getFrameAllocations() const
+{
+    return frame_allocations;
+}
+
+void Vectorizer::SetResolution(int scale, int supersample_)
+{
+    scale = clamp(scale, 1, MAX_OUTPUT_SCALE);
+    supersample_ = clamp(supersample_, 1, MAX_RENDER_SCALE / scale);
+
+    if (vector_buffer.width == FRAME_WIDTH * scale && supersample == supersample_)
+        return;
+
+    supersample = supersample_;
+    redraw_all = true;
+    vector_buffer.resize(FRAME_WIDTH * scale, FRAME_HEIGHT * scale);
+    debug_buffer.resize(FRAME_WIDTH * scale, FRAME_HEIGHT * scale);
+    if (supersample > 1)
+        render_buffer.resize(vector_buffer.width * supersample, vector_buffer.height * supersample);
+    else
+        render_buffer.resize(0, 0);
+    glow.Configure(glow_quality, scale);
+}
+
+void Vectorizer::SetAntialias(bool enabled)
+{
+    if (enabled == antialias)
+        return;
+
+    antialias = enabled;
+    redraw_all = true;
+}
+
+void Vectorizer::SetGlow(glow_quality_t quality)
+{
+    if (quality == glow_quality)
+        return;
+
+    glow_quality = quality;
+    glow.Configure(glow_quality, vector_buffer.width / FRAME_WIDTH);
+    if (!glow.enabled())
+        glow_buffer.resize(0, 0);
+    // the output buffer changes, so all of it has to be converted again
+    redraw_all = true;
+}
 //</editor-fold>
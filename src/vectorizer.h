@@ -7,39 +7,70 @@
 #include <array>
 #include <string>
 #include "gfxutil.h"
+#include "glow.h"
 #include "updatetimer.h"
 
 
 static const float VECTOR_MAX_V =  5.0f;
 static const float VECTOR_MIN_V = -5.0f;
-static const float time_per_clock = (float) (1.0f / 1.5e6);
 static const float DEBUG_LINE_INTENSITY = 0.03f;
 static const int FRAME_WIDTH  = 330;
 static const int FRAME_HEIGHT = 410;
+// output resolution is FRAME_WIDTH/FRAME_HEIGHT multiplied by the output scale, the vectors are drawn
+// at output scale * supersample and box filtered down to the output resolution
+static const int MAX_OUTPUT_SCALE = 4;
+static const int MAX_RENDER_SCALE = 8;
+
+// The analog model is fixed point so that the beam position is the same with every compiler and platform:
+//  - voltages are in DAC steps of 5/256 V, 256 steps = 5 V
+//  - time is in ticks of 1/1000th of a clock cycle (1/1.5 GHz)
+//  - the integrators move the beam by 10000 * t * V, one tick at one DAC step moves it by 1/7680000 V
+static const int32_t DAC_STEPS_PER_5V = 256;
+static const int64_t TICKS_PER_CYCLE = 1000;
+static const int64_t POSITION_PER_VOLT = 7680000;
+// beam intensity is 16.16 fixed point, 1.0 is a Z sample and hold of 5 V
+static const int32_t INTENSITY_ONE = 1 << 16;
 
 struct integrators_t
 {
-    float x = 0.0f,
-            y = 0.0f;
+    // in DAC steps
+    int32_t x = 0,
+            y = 0;
 };
 
 struct axes_t
 {
-    float x = 0.0f,
-            y = 0.0f;
+    // in 1/POSITION_PER_VOLT V
+    int64_t x = 0,
+            y = 0;
     inline void zero() {
-        x = 0.0f;
-        y = 0.0f;
+        x = 0;
+        y = 0;
     }
-    inline void integrate(float ramp_time, const integrators_t &integrators)
+    inline void integrate(int64_t ramp_ticks, const integrators_t &integrators)
     {
-        x += 10000 * ramp_time * integrators.x;
-        y += 10000 * ramp_time * integrators.y;
+        x += ramp_ticks * integrators.x;
+        y += ramp_ticks * integrators.y;
     }
+    inline float volts_x() const { return x * (1.0f / POSITION_PER_VOLT); }
+    inline float volts_y() const { return y * (1.0f / POSITION_PER_VOLT); }
 };
 
-using VectorBuffer = vxgfx::framebuffer<FRAME_WIDTH, FRAME_HEIGHT, vxgfx::pf_mono_t>;
-using DebugBuffer = vxgfx::framebuffer<FRAME_WIDTH, FRAME_HEIGHT, vxgfx::pf_argb_t>;
+// A beam segment of the display list, it is plain data so it can be handed straight to a vector monitor,
+// an XY oscilloscope driver or another process
+struct vector_segment_t
+{
+    // end points in volts, the screen is X [-2.5, 2.5] and Y [-5, 5]
+    float x0, y0, x1, y1;
+    // 0.0 - 1.0, faded by the time since it was drawn
+    float intensity;
+    // the cycles the beam was turned on and off
+    uint64_t start_cycle, end_cycle;
+};
+
+using DisplayList = std::vector<vector_segment_t>;
+using VectorBuffer = vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t>;
+using DebugBuffer = vxgfx::overlay_buffer<vxgfx::pf_argb_t>;
 
 class Vectorizer
 {
@@ -47,15 +78,47 @@ class Vectorizer
     {
         axes_t pos;
         uint8_t blank, ramp;
-        float intensity;
-        uint64_t end_cycle;
+        int32_t intensity;
+        // the cycle the vector was drawn and the cycle it was last decayed
+        uint64_t cycle, end_cycle;
+    };
+
+    struct line_vector_t
+    {
+        axes_t p0, p1;
+        int32_t intensity0, intensity1;
+        uint64_t cycles0, cycles1;
+        line_vector_t(axes_t pos, int32_t intensity_, uint64_t cycles_)
+        {
+            p0 = p1 = pos;
+            intensity0 = intensity1 = intensity_;
+            cycles0 = cycles1 = cycles_;
+        };
+        line_vector_t(axes_t pos, uint64_t cycles_)
+        {
+            p0 = p1 = pos;
+            intensity0 = intensity1 = 0;
+            cycles0 = cycles1 = cycles_;
+        }
+        void set_end(axes_t pos, uint64_t cycles_)
+        {
+            p1 = pos;
+            cycles1 = cycles_;
+        }
     };
 
-    // Sample and hold voltages (-5v - 5v) for Y axis and Z axis
-    float sample_y = 0.0f;
-    float sample_z = 0.0f;
+    // RAMP/ZERO and the integrator inputs, these reach the integrators after signal_delay
+    struct signals_t
+    {
+        uint8_t ramp, zero;
+        integrators_t integrators;
+    };
+
+    // Sample and hold voltages (-5v - 5v) for Y axis and Z axis, in DAC steps
+    int32_t sample_y = 0;
+    int32_t sample_z = 0;
     // not really a sample and hold, the value of X is whatever is out of the DAC ie. PORTA
-    float sample_x = 0.0f;
+    int32_t sample_x = 0;
 
     // DAC voltage for the X/Y axes
     axes_t axes;
@@ -64,10 +127,10 @@ class Vectorizer
     integrators_t integrators;
 
     // The DAC is connected to PORTA, the MSB of the input is inverted
-    // the output from the DAC will range from -2.5v to +2.5v
-    inline float dac(uint8_t value)
+    // the output from the DAC will range from -2.5v to +2.5v, ie. -127 to +128 DAC steps
+    inline int32_t dac(uint8_t value)
     {
-        return 2.5f - ((value ^ 0x80) * (5.0f / 256.0f));
+        return DAC_STEPS_PER_5V / 2 - (value ^ 0x80);
     }
 
     template <typename T>
@@ -89,27 +152,89 @@ class Vectorizer
 
     // The DAC could add a delay of up to ~150ns.
     // Total delay:
-    CallbackTimer signal_queue;
+    SignalTimer<signals_t> signal_queue;
 
     uint64_t cycles = 0;
 
     vxgfx::viewport vp;
 
+    // Translate a beam position to pixel coordinates in a w x h buffer, scale is 16.16 fixed point. The
+    // coordinates have subpixel_bits of fractional precision.
+    std::pair<int, int> translate(const axes_t &pos, int64_t scale, int w, int h, int subpixel_bits = 0) const;
+
+    // Build the lines to draw from the recorded vectors and decay them
+    void CollectVectors();
+
     std::vector<Vector> vectors_;
-    VectorBuffer vector_buffer{};
-    DebugBuffer debug_buffer{};
+    // the lines to draw, rebuilt every frame but the capacity is kept between frames
+    std::vector<line_vector_t> to_draw;
+    std::vector<line_vector_t> debug_to_draw;
+    DisplayList display_list;
+    // the cycle to_draw was last built, the vectors are only collected and decayed once per cycle
+    uint64_t collected_cycles = UINT64_MAX;
+    VectorBuffer vector_buffer{FRAME_WIDTH, FRAME_HEIGHT};
+    // only used when supersampling, the vectors are drawn here and downsampled in to vector_buffer
+    VectorBuffer render_buffer{};
+    DebugBuffer debug_buffer{FRAME_WIDTH, FRAME_HEIGHT};
+    int supersample = 1;
+
+    // the phosphor glow, when it is enabled the output is vector_buffer with the glow added
+    Glow glow;
+    glow_quality_t glow_quality = GLOW_OFF;
+    VectorBuffer glow_buffer{};
+
+    // draw antialiased lines instead of Bresenham lines
+    bool antialias = false;
+
+    // areas of the render target drawn to this frame and the previous frame, in render target pixels
+    vxgfx::dirty_region dirty{}, dirty_prev{};
+    // areas of vector_buffer that changed in the last call to getVectorBuffer
+    vxgfx::dirty_region changed{};
+    // the whole buffer needs to be redrawn, eg. after a resize
+    bool redraw_all = true;
 
     float min_x, max_x, min_y, max_y;
 
+    // container capacities at the end of the last frame, used to count the containers that had to grow
+    std::array<size_t, 5> capacities{};
+    int frame_allocations = 0;
+
 public:
+    Vectorizer();
+
     void Step(uint8_t porta, uint8_t portb, uint8_t zero, uint8_t blank);
 
     // Returns a vxgfx::framebuffer<vxgfx::pf_mono_t>
     VectorBuffer *getVectorBuffer();
 
+    // Fade the vectors of a frame that is not displayed, without drawing them. The next call to getVectorBuffer
+    // draws the frame as if every frame had been drawn.
+    void SkipFrame();
+
     // Returns a vxgfx::framebuffer<vxgfx::pf_argb_t>
     DebugBuffer *getDebugBuffer();
 
+    // Returns the beam segments that are visible now, without rasterizing them. The storage is reused, the
+    // reference is valid until the next call.
+    const DisplayList &getDisplayList();
+
+    // Returns the areas of the vector buffer that changed in the last call to getVectorBuffer
+    const vxgfx::dirty_region &getDirtyRegion() const;
+
+    // Set the output resolution to scale * FRAME_WIDTH/FRAME_HEIGHT, vectors are drawn at scale * supersample.
+    // Both are clamped to the MAX_OUTPUT_SCALE and MAX_RENDER_SCALE limits.
+    void SetResolution(int scale, int supersample);
+
+    // Set the quality of the phosphor glow that is added to the vector buffer, GLOW_OFF disables it
+    void SetGlow(glow_quality_t quality);
+
+    // Draw the vectors as antialiased lines
+    void SetAntialias(bool enabled);
+
+    // Returns the number of containers that had to grow (ie. allocate) in the last frame, this should be 0 once
+    // the emulation has warmed up
+    int getFrameAllocations() const;
+
     uint64_t signal_delay = 7800;
     int decay_cycles = 40000; // a beam lasts for 40k cycles
     float scale_factor = 1.0f;
@@ -38,45 +38,64 @@ void Vectrex::Reset()
     cpu_->Reset();
 }
 
+uint64_t Vectrex::Step()
+{
+    uint64_t cpu_cycles = 0;
+    // run one instruction on the CPU
+    // The VIA 6522 interrupt line is connected to the M6809 IRQ line
+    m6809_error_t rcode = cpu_->Execute(cpu_cycles, (via_->GetIRQ()) ? IRQ : NONE);
+    if (rcode != E_SUCCESS)
+    {
+        auto registers = cpu_->getRegisters();
+        if (rcode == E_UNKNOWN_OPCODE)
+            message("Unknown opcode at $%04x [$%02x]", registers.PC - 1, Read((uint16_t) (registers.PC - 1)));
+        else if (rcode == E_UNKNOWN_OPCODE_PAGE1)
+            message("Unknown page 1 opcode at $%04x [$%02x]", registers.PC - 1,
+                    Read((uint16_t) (registers.PC - 1)));
+        else if (rcode == E_UNKNOWN_OPCODE_PAGE2)
+            message("Unknown page 2 opcode at $%04x [$%02x]", registers.PC - 1),
+                    Read((uint16_t) (registers.PC - 1));
+    }
+
+    // run the VIA for the same number of cycles
+    for (int via_cycles = 0; via_cycles < cpu_cycles; via_cycles++)
+    {
+        via_->Step();
+        vector_buffer_.Step(via_->getPortAState(), via_->getPortBState(),
+                            via_->getCA2State(), via_->getCB2State());
+        UpdateJoystick(via_->getPortAState(), via_->getPortBState());
+        this->cycles++;
+    }
+
+    return cpu_cycles;
+}
+
 uint64_t Vectrex::Run(uint64_t cycles)
 {
     uint64_t cycles_run = 0;
     while (cycles_run < cycles)
     {
-        uint64_t cpu_cycles = 0;
-        // run one instruction on the CPU
-        // The VIA 6522 interrupt line is connected to the M6809 IRQ line
-        m6809_error_t rcode = cpu_->Execute(cpu_cycles, (via_->GetIRQ()) ? IRQ : NONE);
-        if (rcode != E_SUCCESS)
-        {
-            auto registers = cpu_->getRegisters();
-            if (rcode == E_UNKNOWN_OPCODE)
-                message("Unknown opcode at $%04x [$%02x]", registers.PC - 1, Read((uint16_t) (registers.PC - 1)));
-            else if (rcode == E_UNKNOWN_OPCODE_PAGE1)
-                message("Unknown page 1 opcode at $%04x [$%02x]", registers.PC - 1,
-                        Read((uint16_t) (registers.PC - 1)));
-            else if (rcode == E_UNKNOWN_OPCODE_PAGE2)
-                message("Unknown page 2 opcode at $%04x [$%02x]", registers.PC - 1),
-                        Read((uint16_t) (registers.PC - 1));
-        }
-
-        // run the VIA for the same number of cycles
-        for (int via_cycles = 0; via_cycles < cpu_cycles; via_cycles++)
-        {
-            via_->Step();
-            vector_buffer_.Step(via_->getPortAState(), via_->getPortBState(),
-                                via_->getCA2State(), via_->getCB2State());
-            UpdateJoystick(via_->getPortAState(), via_->getPortBState());
-            psg_->Step(via_->getPortAState(), (uint8_t) ((via_->getPortBState() >> 3) & 1),
-                       1, (uint8_t) ((via_->getPortBState() >> 4) & 1));
-            this->cycles++;
-        }
+        cycles_run += Step();
+    }
+    return cycles_run;
+}
 
-        cycles_run += cpu_cycles;
+uint64_t Vectrex::RunFrame(uint64_t max_cycles)
+{
+    uint64_t cycles_run = 0;
+    frame_sync_ = false;
+    while (cycles_run < max_cycles && !frame_sync_)
+    {
+        cycles_run += Step();
     }
     return cycles_run;
 }
 
+bool Vectrex::FrameSynced() const
+{
+    return frame_sync_;
+}
+
 bool Vectrex::LoadCartridge(const uint8_t *data, size_t size)
 {
     cartridge_ = std::make_unique<Cartridge>();
@@ -122,6 +141,11 @@ static uint8_t read_via_portb(intptr_t ref)
     return reinterpret_cast<Vectrex*>(ref)->ReadPortB();
 }
 
+static void via_port_write(intptr_t ref, uint8_t porta, uint8_t portb)
+{
+    reinterpret_cast<Vectrex*>(ref)->UpdateSound(porta, portb);
+}
+
 Vectrex::Vectrex() noexcept
 {
     cpu_ = std::make_unique<M6809>();
@@ -135,6 +159,7 @@ Vectrex::Vectrex() noexcept
     // VIA Callback
     via_->SetPortAReadCallback(read_via_porta, reinterpret_cast<intptr_t>(this));
     via_->SetPortBReadCallback(read_via_portb, reinterpret_cast<intptr_t>(this));
+    via_->SetPortWriteCallback(via_port_write, reinterpret_cast<intptr_t>(this));
 
     // PSG callbacks
     psg_->SetIOReadCallback(read_psg_io, reinterpret_cast<intptr_t>(this));
@@ -190,6 +215,9 @@ void Vectrex::Write(uint16_t addr, uint8_t data)
         }
         if (addr & 0x1000) {
             // D000-D7FF: 6522VIA I/O
+            // Wait_Recal waits for timer 2 to expire and then reloads it, that is the start of the next frame
+            if ((addr & 0xf) == REG_T2CH && (via_->Read(REG_IFR) & TIMER2_INT))
+                frame_sync_ = true;
             via_->Write((uint8_t) (addr & 0xf), data);
         }
     }
@@ -251,6 +279,17 @@ void Vectrex::UpdateJoystick(uint8_t porta, uint8_t portb) {
     joystick_compare = (uint8_t) ((pot > (porta ^ 0x80)) ? 0x20 : 0);
 }
 
+void Vectrex::UpdateSound(uint8_t porta, uint8_t portb)
+{
+    // porta is the databus of the sound chip, PB3 is BC1 and PB4 is BDIR (BC2 is tied high)
+    psg_->Step(porta, (uint8_t) ((portb >> 3) & 1), 1, (uint8_t) ((portb >> 4) & 1), this->cycles);
+
+    // with the multiplexer enabled (PB0 low) and selecting 3 (PB1, PB2) the DAC drives the sound output, this
+    // is how games play samples and speech
+    if ((portb & 0x7) == 0x6)
+        psg_->WriteDAC((int8_t) porta, this->cycles);
+}
+
 void Vectrex::SetPlayerOne(uint8_t x, uint8_t y, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4)
 {
     // the sticks are analog and range from 0x00 -> 0xff (left -> right/down -> up)
@@ -297,11 +336,41 @@ VectorBuffer *Vectrex::getFramebuffer()
     return vector_buffer_.getVectorBuffer();
 }
 
+void Vectrex::SkipFrame()
+{
+    vector_buffer_.SkipFrame();
+}
+
 DebugBuffer *Vectrex::getDebugbuffer()
 {
     return vector_buffer_.getDebugBuffer();
 }
 
+const DisplayList &Vectrex::getDisplayList()
+{
+    return vector_buffer_.getDisplayList();
+}
+
+const vxgfx::dirty_region &Vectrex::getDirtyRegion() const
+{
+    return vector_buffer_.getDirtyRegion();
+}
+
+void Vectrex::SetResolution(int scale, int supersample)
+{
+    vector_buffer_.SetResolution(scale, supersample);
+}
+
+void Vectrex::SetGlow(glow_quality_t quality)
+{
+    vector_buffer_.SetGlow(quality);
+}
+
+void Vectrex::SetAntialias(bool enabled)
+{
+    vector_buffer_.SetAntialias(enabled);
+}
+
 M6809 &Vectrex::GetM6809()
 {
     return *cpu_;
@@ -57,13 +57,19 @@ class Vectrex
     uint8_t joystick_compare;
     uint8_t psg_port;
 
+    // set when the game reloads timer 2 after it expired, this is how the BIOS Wait_Recal starts a new frame
+    bool frame_sync_ = false;
+
+    // Run one CPU instruction and the rest of the hardware for the same number of cycles
+    uint64_t Step();
+
 public:
     std::unique_ptr<Cartridge> cartridge_{};
     std::unique_ptr<M6809> cpu_{};
     std::unique_ptr<VIA6522> via_{};
     std::unique_ptr<AY38910> psg_{};
     Vectorizer vector_buffer_;
-    uint64_t cycles;
+    uint64_t cycles = 0;
 
     Vectrex() noexcept;
     Vectrex(const Vectrex&) = delete;
@@ -74,6 +80,10 @@ public:
 
     void Reset();
     uint64_t Run(uint64_t cycles);
+    // Run until the game starts its next frame, or for max_cycles if it does not sync before then
+    uint64_t RunFrame(uint64_t max_cycles);
+    // Returns true if the last call to RunFrame ended at the start of a frame
+    bool FrameSynced() const;
 
     bool LoadCartridge(const uint8_t *data, size_t size);
     void UnloadCartridge();
@@ -87,11 +97,20 @@ public:
     void message(const char *fmt, ...);
 
     VectorBuffer *getFramebuffer();
+    // Call instead of getFramebuffer for frames that are not displayed
+    void SkipFrame();
     DebugBuffer *getDebugbuffer();
+    const DisplayList &getDisplayList();
+    const vxgfx::dirty_region &getDirtyRegion() const;
+    void SetResolution(int scale, int supersample);
+    void SetGlow(glow_quality_t quality);
+    void SetAntialias(bool enabled);
 
     uint8_t ReadPortA();
     uint8_t ReadPortB();
     void UpdateJoystick(uint8_t porta, uint8_t portb);
+    // Called by the VIA when a write changes port a or b, the sound chip and DAC are only updated then
+    void UpdateSound(uint8_t porta, uint8_t portb);
     void SetPlayerOne(uint8_t x, uint8_t y, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4);
     void SetPlayerTwo(uint8_t x, uint8_t y, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4);
     uint8_t ReadPSGIO();
@@ -122,6 +122,8 @@ uint8_t VIA6522::Read(uint8_t reg)
 
 void VIA6522::Write(uint8_t reg, uint8_t data)
 {
+    const uint8_t porta = getPortAState(), portb = getPortBState();
+
     switch (reg & 0xf) {
 
         case REG_ORB:
@@ -225,6 +227,10 @@ void VIA6522::Write(uint8_t reg, uint8_t data)
         default:
             break;
     }
+
+    // the devices on the ports only need to know when they change, rather than checking every cycle
+    if (port_write_func && (porta != getPortAState() || portb != getPortBState()))
+        port_write_func(port_write_ref, getPortAState(), getPortBState());
 }
 
 void VIA6522::Reset()
@@ -379,6 +385,12 @@ void VIA6522::SetPortBReadCallback(VIA6522::port_callback_t func, intptr_t ref)
     portb_callback_ref = ref;
 }
 
+void VIA6522::SetPortWriteCallback(VIA6522::port_write_callback_t func, intptr_t ref)
+{
+    port_write_func = func;
+    port_write_ref = ref;
+}
+
 uint8_t VIA6522::GetIRQ()
 {
     return registers.IFR & IRQ_MASK;
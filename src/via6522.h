@@ -134,6 +134,7 @@ class VIA6522
 {
     using port_callback_t = uint8_t (*)(intptr_t);
     using update_callback_t = void (*)(intptr_t, uint8_t, uint8_t, bool, bool, bool, bool);
+    using port_write_callback_t = void (*)(intptr_t, uint8_t, uint8_t);
 
     struct Timer
     {
@@ -237,6 +238,9 @@ class VIA6522
     intptr_t        porta_callback_ref = 0;
     port_callback_t portb_callback_func = nullptr;
     intptr_t        portb_callback_ref = 0;
+    // called with the new port a/b states when a write changes them
+    port_write_callback_t port_write_func = nullptr;
+    intptr_t              port_write_ref = 0;
 
     // Signals that need to be updated in the future
     UpdateTimer<uint8_t> delayed_signals;
@@ -323,6 +327,7 @@ public:
     void SetPortAReadCallback(port_callback_t func, intptr_t ref);
     void SetPortBReadCallback(port_callback_t func, intptr_t ref);
     void SetUpdateCallback(update_callback_t func, intptr_t ref);
+    void SetPortWriteCallback(port_write_callback_t func, intptr_t ref);
 
     uint8_t Read(uint8_t reg);              // read from VIA register
     void Write(uint8_t reg, uint8_t data);  // write to VIA register
@@ -0,0 +1,124 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "audiowriter.h"
+
+static std::vector<uint8_t> read_file(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static uint32_t get_u32(const std::vector<uint8_t> &data, size_t pos)
+{
+    return data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16 | (uint32_t) data[pos + 3] << 24;
+}
+
+static int16_t get_s16(const std::vector<uint8_t> &data, size_t pos)
+{
+    return (int16_t) (data[pos] | data[pos + 1] << 8);
+}
+
+// The sample of channel c of file o in frame f, every sample written is different
+static int16_t sample(size_t f, size_t o, size_t c)
+{
+    return (int16_t) (f * 16 + o * 4 + c - 20000);
+}
+
+TEST_CASE("AudioWriter Files", "[audiowriter]") {
+    const auto dir = std::filesystem::temp_directory_path();
+    const std::vector<std::string> filenames = { (dir / "audiowriter_test_0").string(),
+                                                 (dir / "audiowriter_test_1").string(),
+                                                 (dir / "audiowriter_test_2").string() };
+    const unsigned channels = GENERATE(1u, 2u);
+    const auto format = GENERATE(vectaudio::FORMAT_WAV, vectaudio::FORMAT_RAW);
+    const size_t frames = 3000;
+
+    {
+        vectaudio::AudioWriter writer;
+        // a small ring, the writes have to wait for the writer thread
+        writer.buffer_frames = 256;
+        REQUIRE(writer.open(filenames, channels, 22050, format));
+        REQUIRE(writer.is_open());
+
+        // a frame is the channels of each file in turn, written in uneven batches
+        std::vector<int16_t> data;
+        for (size_t f = 0; f < frames; f++)
+            for (size_t o = 0; o < filenames.size(); o++)
+                for (unsigned c = 0; c < channels; c++)
+                    data.push_back(sample(f, o, c));
+        const size_t frame_size = filenames.size() * channels;
+        for (size_t f = 0; f < frames; f += 7)
+            writer.write(data.data() + f * frame_size, std::min<size_t>(7, frames - f));
+
+        REQUIRE(writer.close());
+        REQUIRE_FALSE(writer.is_open());
+    }
+
+    const size_t data_bytes = frames * channels * 2;
+    for (size_t o = 0; o < filenames.size(); o++) {
+        const auto file = read_file(filenames[o]);
+        size_t pos = 0;
+        if (format == vectaudio::FORMAT_WAV) {
+            // the sizes are filled in on close
+            REQUIRE(file.size() == 44 + data_bytes);
+            REQUIRE(std::memcmp(file.data(), "RIFF", 4) == 0);
+            REQUIRE(get_u32(file, 4) == 36 + data_bytes);
+            REQUIRE(std::memcmp(file.data() + 8, "WAVEfmt ", 8) == 0);
+            REQUIRE(get_u32(file, 24) == 22050);
+            REQUIRE(std::memcmp(file.data() + 36, "data", 4) == 0);
+            REQUIRE(get_u32(file, 40) == data_bytes);
+            pos = 44;
+        } else {
+            REQUIRE(file.size() == data_bytes);
+        }
+
+        // each file has only its own channels
+        bool same = true;
+        for (size_t f = 0; f < frames; f++)
+            for (unsigned c = 0; c < channels; c++, pos += 2)
+                same = same && get_s16(file, pos) == sample(f, o, c);
+        REQUIRE(same);
+
+        std::filesystem::remove(filenames[o]);
+    }
+}
+
+TEST_CASE("AudioWriter Errors", "[audiowriter]") {
+    vectaudio::AudioWriter writer;
+    REQUIRE_FALSE(writer.open({ (std::filesystem::temp_directory_path() / "missing" / "file.wav").string() }, 1,
+                              44100, vectaudio::FORMAT_WAV));
+    REQUIRE_FALSE(writer.is_open());
+
+    // nothing can be written to a full device, closing reports it
+    if (std::filesystem::exists("/dev/full")) {
+        REQUIRE(writer.open({ "/dev/full" }, 1, 44100, vectaudio::FORMAT_WAV));
+        const int16_t data[1024] = {};
+        writer.write(data, 1024);
+        REQUIRE_FALSE(writer.close());
+    }
+}
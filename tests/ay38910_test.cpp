@@ -0,0 +1,314 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include "ay38910.h"
+
+// count the crossings of the output, the first half second is skipped while the DC offset settles
+static int count_crossings(AY38910 &psg, int samples)
+{
+    std::vector<int16_t> buffer(2048);
+    int crossings = 0;
+    bool high = false;
+    uint64_t cycle = 0;
+    for (int n = 0; n < 22050 + samples;)
+    {
+        // 20ms frames
+        psg.EndFrame(cycle += 30000);
+        const int count = (int) psg.FillBuffer(buffer.data(), buffer.size() / 2);
+        for (int i = 0; i < count; i++, n++)
+        {
+            // some hysteresis for the ringing of the band-limited edges
+            const bool now = high ? buffer[i * 2] > -2048 : buffer[i * 2] > 2048;
+            if (n >= 22050 && n < 22050 + samples)
+                crossings += now != high;
+            high = now;
+        }
+    }
+    return crossings;
+}
+
+TEST_CASE("AY38910 Tone", "[ay38910]")
+{
+    AY38910 psg;
+    // tone A only, fixed full volume
+    psg.Write(PSG_REG_MIXER_CTRL, 0x3e);
+    psg.Write(PSG_REG_A_AMPL, 0x0f);
+
+    SECTION("Frequency")
+    {
+        // 1.5MHz / (16 * 100) = 937.5Hz
+        psg.Write(PSG_REG_A_COARSE, 0);
+        psg.Write(PSG_REG_A_FINE, 100);
+        REQUIRE(psg.channel_a.frequency() == 937.5);
+        // a channel that has not been written has the shortest period
+        REQUIRE(psg.channel_b.frequency() == 93750.0);
+        const int crossings = count_crossings(psg, 44100);
+        REQUIRE(crossings >= 1874);
+        REQUIRE(crossings <= 1876);
+    }
+
+    SECTION("Period")
+    {
+        // 1.5MHz / (16 * 0x3a9) = 100Hz, the period is exact so there is no drift over a long run
+        psg.Write(PSG_REG_A_COARSE, 0x03);
+        psg.Write(PSG_REG_A_FINE, 0xa9);
+        REQUIRE(psg.channel_a.period_ == 0x3a9);
+        const int crossings = count_crossings(psg, 10 * 44100);
+        REQUIRE(crossings >= 1999);
+        REQUIRE(crossings <= 2001);
+    }
+
+    SECTION("Silent")
+    {
+        // a disabled channel at a fixed volume is a constant level, which is removed with the DC offset
+        psg.Write(PSG_REG_MIXER_CTRL, 0x3f);
+        REQUIRE(count_crossings(psg, 44100) == 0);
+    }
+
+    SECTION("Timed writes")
+    {
+        // writes part way through a frame take effect at their cycle, 20ms of 1kHz then 20ms of silence
+        std::vector<int16_t> buffer(4096);
+        psg.Write(PSG_REG_A_FINE, 94, 0);
+        psg.Write(PSG_REG_A_AMPL, 0x00, 30000);
+        psg.Write(PSG_REG_A_AMPL, 0x0f, 60000);
+        psg.EndFrame(60000);
+        REQUIRE(psg.FillBuffer(buffer.data(), buffer.size() / 2) == 1764);
+
+        // the silence is not at 0 straight away, the DC offset of the tone decays, but there are no edges
+        int first = 0, second = 0;
+        for (int i = 1; i < 870; i++)
+            first = std::max(first, std::abs(buffer[i * 2] - buffer[i * 2 - 2]));
+        for (int i = 900; i < 1764; i++)
+            second = std::max(second, std::abs(buffer[i * 2] - buffer[i * 2 - 2]));
+        REQUIRE(first > 4096);
+        REQUIRE(second < 512);
+    }
+
+    SECTION("Band-limited")
+    {
+        // a tone above the nyquist frequency is filtered out rather than aliased
+        psg.Write(PSG_REG_A_COARSE, 0);
+        psg.Write(PSG_REG_A_FINE, 1);
+        REQUIRE(count_crossings(psg, 44100) == 0);
+    }
+}
+
+TEST_CASE("AY38910 DAC", "[ay38910]")
+{
+    AY38910 psg;
+    psg.Write(PSG_REG_MIXER_CTRL, 0x3f);
+
+    // a 1kHz square wave played through the DAC, 16 writes a frame
+    std::vector<int16_t> buffer(2048);
+    int crossings = 0;
+    bool high = false;
+    for (uint64_t cycle = 0; cycle < 30000; cycle += 750)
+        psg.WriteDAC((cycle / 750) & 1 ? 100 : -100, cycle);
+    psg.EndFrame(30000);
+    const auto count = psg.FillBuffer(buffer.data(), buffer.size() / 2);
+    REQUIRE(count == 882);
+    for (size_t i = 0; i < count; i++)
+    {
+        const bool now = high ? buffer[i * 2] > -2048 : buffer[i * 2] > 2048;
+        crossings += now != high;
+        high = now;
+    }
+    REQUIRE(crossings >= 38);
+    REQUIRE(crossings <= 40);
+
+    // the output is mono, the same in both channels
+    bool same = true;
+    for (size_t i = 0; i < count; i++)
+        same = same && buffer[i * 2] == buffer[i * 2 + 1];
+    REQUIRE(same);
+}
+
+TEST_CASE("AY38910 Stems", "[ay38910]")
+{
+    AY38910 psg;
+    psg.EnableStems(true);
+    // tone on A, noise alone on B, C is silent and the DAC plays a square wave
+    psg.Write(PSG_REG_MIXER_CTRL, 0x2e);
+    psg.Write(PSG_REG_A_FINE, 100);
+    psg.Write(PSG_REG_A_AMPL, 0x0f);
+    psg.Write(PSG_REG_B_AMPL, 0x0f);
+    psg.Write(PSG_REG_NOISE, 4);
+
+    std::vector<int16_t> mixed(2048), stems(1024 * AY38910::STEM_COUNT);
+    int64_t energy[AY38910::STEM_COUNT] = {};
+    int max_error = 0;
+    for (uint64_t cycle = 0, frame = 0; frame < 10; frame++)
+    {
+        for (int i = 0; i < 40; i++, cycle += 750)
+            psg.WriteDAC(i & 1 ? 50 : -50, cycle);
+        psg.EndFrame(cycle);
+        const auto count = psg.FillBuffer(mixed.data(), mixed.size() / 2);
+        REQUIRE(psg.FillStems(stems.data(), count) == count);
+        for (size_t i = 0; i < count; i++)
+        {
+            int sum = 0;
+            for (int s = 0; s < AY38910::STEM_COUNT; s++)
+            {
+                const int v = stems[i * AY38910::STEM_COUNT + s];
+                sum += v;
+                energy[s] += v * v;
+            }
+            max_error = std::max(max_error, std::abs(sum - mixed[i * 2]));
+        }
+    }
+
+    // the stems add up to the mixed output, apart from the rounding of each one
+    REQUIRE(max_error <= AY38910::STEM_COUNT);
+    REQUIRE(energy[AY38910::STEM_A] > 0);
+    REQUIRE(energy[AY38910::STEM_B] == 0);
+    REQUIRE(energy[AY38910::STEM_C] == 0);
+    REQUIRE(energy[AY38910::STEM_NOISE] > 0);
+    REQUIRE(energy[AY38910::STEM_DAC] > 0);
+}
+
+TEST_CASE("AY38910 Sample rate", "[ay38910]")
+{
+    AY38910 psg;
+    std::vector<int16_t> buffer(8192);
+
+    // the fraction of a sample left at the end of a frame is carried over
+    psg.SetSampleRate(48000);
+    size_t total = 0;
+    for (uint64_t cycle = 30000; cycle <= 30000 * 10; cycle += 30000)
+    {
+        psg.EndFrame(cycle);
+        total += psg.FillBuffer(buffer.data(), buffer.size() / 2);
+    }
+    REQUIRE(total >= 9599);
+    REQUIRE(total <= 9600);
+
+    psg.SetSampleRate(96000);
+    psg.EndFrame(30000 * 12);
+    total = psg.FillBuffer(buffer.data(), buffer.size() / 2);
+    REQUIRE(total >= 3840);
+    REQUIRE(total <= 3841);
+
+    // the adjustment is spread over a number of frames
+    psg.SetRateAdjust(1.01);
+    size_t first = 0, last = 0;
+    for (uint64_t cycle = 30000 * 13; cycle <= 30000 * 50; cycle += 30000)
+    {
+        psg.EndFrame(cycle);
+        last = psg.FillBuffer(buffer.data(), buffer.size() / 2);
+        if (!first)
+            first = last;
+    }
+    REQUIRE(first <= 1922);
+    REQUIRE(last >= 1938);
+    REQUIRE(last <= 1940);
+}
+
+TEST_CASE("AY38910 Envelope shapes", "[ay38910]")
+{
+    AY38910 psg;
+    auto levels = [&psg](uint8_t shape) {
+        psg.Write(PSG_REG_ENV_CTRL, shape);
+        std::vector<int> out;
+        for (int i = 0; i < 96; i++)
+        {
+            out.push_back(psg.envelope.output());
+            psg.envelope.advance(1);
+        }
+        return out;
+    };
+
+    SECTION("Decay and hold at 0")
+    {
+        const auto out = levels(0x00);
+        REQUIRE(out[0] == 15);
+        REQUIRE(out[15] == 0);
+        REQUIRE(out[16] == 0);
+        REQUIRE(out[95] == 0);
+    }
+
+    SECTION("Attack and hold at 15")
+    {
+        const auto out = levels(0x0d);
+        REQUIRE(out[0] == 0);
+        REQUIRE(out[15] == 15);
+        REQUIRE(out[95] == 15);
+    }
+
+    SECTION("Triangle")
+    {
+        const auto out = levels(0x0e);
+        bool triangle = true;
+        for (int i = 0; i < 96; i++)
+            triangle = triangle && out[i] == (((i / 16) & 1) ? 15 - i % 16 : i % 16);
+        REQUIRE(triangle);
+    }
+
+    SECTION("Sawtooth")
+    {
+        const auto out = levels(0x08);
+        bool sawtooth = true;
+        for (int i = 0; i < 96; i++)
+            sawtooth = sawtooth && out[i] == 15 - i % 16;
+        REQUIRE(sawtooth);
+    }
+
+    SECTION("Skip ahead")
+    {
+        psg.Write(PSG_REG_ENV_CTRL, 0x0a);
+        psg.envelope.advance(1000);
+        const int skipped = psg.envelope.output();
+        psg.Write(PSG_REG_ENV_CTRL, 0x0a);
+        for (int i = 0; i < 1000; i++)
+            psg.envelope.advance(1);
+        REQUIRE(skipped == psg.envelope.output());
+    }
+}
+
+TEST_CASE("AY38910 Noise sequence", "[ay38910]")
+{
+    AY38910 psg;
+    auto &noise = psg.channel_noise;
+
+    // the sequence repeats after NOISE_PERIOD ticks and skipping gives the same output as ticking
+    std::vector<uint8_t> first;
+    for (int i = 0; i < 64; i++)
+    {
+        first.push_back(noise.output());
+        noise.tick();
+    }
+    noise.advance(AY38910::NOISE_PERIOD - 64);
+    bool repeats = true;
+    for (int i = 0; i < 64; i++)
+    {
+        repeats = repeats && first[i] == noise.output();
+        noise.tick();
+    }
+    REQUIRE(repeats);
+
+    // about half of the bits are set
+    int set = 0;
+    for (uint32_t i = 0; i < AY38910::NOISE_PERIOD; i++)
+    {
+        set += noise.output();
+        noise.advance(1);
+    }
+    REQUIRE(set == 65536);
+}
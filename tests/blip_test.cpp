@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include "blip.h"
+
+TEST_CASE("BlipBuffer Clocks", "[blip]")
+{
+    BlipBuffer blip(1024);
+    blip.SetRates(1500000, 44100);
+
+    // 30000 clocks is 882 samples
+    REQUIRE(blip.ClocksNeeded(882) == 30000);
+    blip.EndFrame(30000);
+    REQUIRE(blip.SamplesAvailable() == 882);
+
+    std::vector<int16_t> out(882);
+    REQUIRE(blip.ReadSamples(out.data(), 1000) == 882);
+    REQUIRE(blip.SamplesAvailable() == 0);
+
+    // the fractions of a sample carry over between frames
+    uint32_t clocks = 0;
+    for (int frame = 0; frame < 100; frame++)
+    {
+        const uint32_t needed = blip.ClocksNeeded(100);
+        blip.EndFrame(needed);
+        clocks += needed;
+        REQUIRE(blip.ReadSamples(out.data(), 100) == 100);
+    }
+    REQUIRE(clocks >= 340135);
+    REQUIRE(clocks <= 340137);
+}
+
+TEST_CASE("BlipBuffer Step", "[blip]")
+{
+    BlipBuffer blip(1024);
+    blip.SetRates(1500000, 44100);
+
+    blip.AddDelta(1000, 10000);
+    blip.EndFrame(blip.ClocksNeeded(128));
+    std::vector<int16_t> out(128);
+    REQUIRE(blip.ReadSamples(out.data(), out.size()) == 128);
+
+    // the step is at sample 29.4 plus the delay of the kernel, there is nothing before the start of the kernel and
+    // only a little ringing up to the step, then it decays with the high pass
+    const int step = 29 + BlipBuffer::WIDTH / 2 - 1;
+    bool before = true, ringing = true;
+    for (int i = 0; i <= step - BlipBuffer::WIDTH / 2; i++)
+        before = before && out[i] == 0;
+    for (int i = step - BlipBuffer::WIDTH / 2; i < step; i++)
+        ringing = ringing && std::abs(out[i]) < 1500;
+    REQUIRE(before);
+    REQUIRE(ringing);
+    REQUIRE(out[step + 2] > 9000);
+    REQUIRE(out[step + 2] < 11000);
+    REQUIRE(out[127] < out[step + 8]);
+    REQUIRE(out[127] > 8000);
+}
@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include <string>
+#include "frameskip.h"
+
+// The frames of `count` that are skipped, as a string of s and d for drawn
+static std::string cadence(const frameskip_t &skip, unsigned count)
+{
+    std::string frames;
+    for (unsigned frame = 0; frame < count; frame++)
+        frames += skip.skipped(frame) ? 's' : 'd';
+    return frames;
+}
+
+TEST_CASE("FrameSkip Parse", "[frameskip]") {
+    auto skip = parse_frameskip("3 of 4");
+    REQUIRE(skip.skip == 3);
+    REQUIRE(skip.every == 4);
+
+    // disabled, and anything that would skip every frame, draws every frame
+    for (const char *value : { "disabled", "", "4 of 4", "5 of 4", "1 of 0", "of 2" }) {
+        skip = parse_frameskip(value);
+        REQUIRE(skip.skip == 0);
+        REQUIRE(skip.every == 1);
+    }
+}
+
+TEST_CASE("FrameSkip Cadence", "[frameskip]") {
+    REQUIRE(cadence(parse_frameskip("disabled"), 8) == "dddddddd");
+    REQUIRE(cadence(parse_frameskip("1 of 2"), 8) == "sdsdsdsd");
+    REQUIRE(cadence(parse_frameskip("2 of 3"), 9) == "ssdssdssd");
+    REQUIRE(cadence(parse_frameskip("3 of 4"), 8) == "sssdsssd");
+    REQUIRE(cadence(parse_frameskip("7 of 8"), 16) == "sssssssdsssssssd");
+}
@@ -109,3 +109,211 @@ TEST_CASE("GFXUtil RectInit", "[gfxutil]") {
     REQUIRE(c.right == 20);
     REQUIRE(c.bottom == 20);
 }
+
+TEST_CASE("GFXUtil DynamicFramebufferResize", "[gfxutil]") {
+    auto fb = vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t>(10, 20);
+    REQUIRE(fb.size() == 200);
+    REQUIRE(fb.rect().width() == 10);
+    REQUIRE(fb.rect().height() == 20);
+
+    fb.plot_pixel(2, 3, vxgfx::m_direct(), vxgfx::pf_mono_t{ 1.0f });
+    REQUIRE(fb.get_pixel(2, 3).value == 1.0f);
+
+    fb.resize(20, 40);
+    REQUIRE(fb.size() == 800);
+    REQUIRE(fb.get_pixel(2, 3).value == 0.0f);
+}
+
+TEST_CASE("GFXUtil DownsampleBox", "[gfxutil]") {
+    auto src = vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t>(4, 4);
+    auto dst = vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t>(2, 2);
+
+    // a one pixel wide vertical line in the source
+    vxgfx::draw_line<vxgfx::m_direct>(src, 0, 0, 0, 3, vxgfx::pf_mono_t{ 1.0f });
+    vxgfx::downsample_box(dst, src, 2);
+
+    // keeps the brightness of a line drawn at native resolution
+    REQUIRE(dst.get_pixel(0, 0).value == 1.0f);
+    REQUIRE(dst.get_pixel(0, 1).value == 1.0f);
+    REQUIRE(dst.get_pixel(1, 0).value == 0.0f);
+    REQUIRE(dst.get_pixel(1, 1).value == 0.0f);
+}
+
+TEST_CASE("GFXUtil ConvertMono", "[gfxutil]") {
+    auto src = vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t>(4, 2);
+    auto dst = vxgfx::dynamic_framebuffer<vxgfx::pf_rgb565_t>(4, 2);
+    const vxgfx::mono_lut<vxgfx::pf_rgb565_t> lut{};
+
+    src.plot_pixel(0, 0, vxgfx::m_direct(), vxgfx::pf_mono_t{ 1.0f });
+    src.plot_pixel(1, 0, vxgfx::m_direct(), vxgfx::pf_mono_t{ 2.0f });
+    src.plot_pixel(3, 1, vxgfx::m_direct(), vxgfx::pf_mono_t{ 0.5f });
+    vxgfx::convert_mono(dst, src, lut);
+
+    REQUIRE(dst.get_pixel(0, 0).value == 0xffff);
+    // out of range intensities are clamped
+    REQUIRE(dst.get_pixel(1, 0).value == 0xffff);
+    REQUIRE(dst.get_pixel(2, 0).value == 0x0000);
+    REQUIRE(dst.get_pixel(3, 1).value == vxgfx::pf_rgb565_t(127, 127, 127).value);
+}
+
+TEST_CASE("GFXUtil DirtyRegionMerge", "[gfxutil]") {
+    vxgfx::dirty_region region(2);
+
+    region.add(vxgfx::rect_t(0, 0, 10, 10));
+    region.add(vxgfx::rect_t(5, 5, 10, 10));  // overlaps the first
+    REQUIRE(region.size() == 1);
+    REQUIRE(region.area() == 225);
+
+    region.add(vxgfx::rect_t(0, 0));          // empty rects are ignored
+    region.add(vxgfx::rect_t(20, 20, 5, 5));
+    REQUIRE(region.size() == 2);
+
+    region.add(vxgfx::rect_t(40, 40, 5, 5));  // full, merged in to the last rect
+    REQUIRE(region.size() == 2);
+    REQUIRE(region.area() == 225 + 625);
+}
+
+TEST_CASE("GFXUtil FillRect", "[gfxutil]") {
+    auto fb = vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t>(4, 4, vxgfx::pf_mono_t{ 1.0f });
+    fb.clear(vxgfx::rect_t(-2, -2, 4, 4));
+
+    REQUIRE(fb.get_pixel(0, 0).value == 0.0f);
+    REQUIRE(fb.get_pixel(1, 1).value == 0.0f);
+    REQUIRE(fb.get_pixel(2, 1).value == 1.0f);
+    REQUIRE(fb.get_pixel(1, 2).value == 1.0f);
+}
+
+TEST_CASE("GFXUtil BlendGamma", "[gfxutil]") {
+    auto black = vxgfx::pf_argb_t(0x00, 0x00, 0x00);
+    auto white = vxgfx::pf_argb_t(0xff, 0xff, 0xff);
+
+    // blended in linear space, half way is sqrt(0.5) not 0.5
+    auto half = black.blend(white, 0.5f);
+    REQUIRE(half.comp_r(half) == 180);
+    REQUIRE(half.comp_a(half) == 0xff);
+    REQUIRE(black.blend(white, 0.0f).value == black.value);
+    REQUIRE(black.blend(white, 1.0f).value == white.value);
+
+    auto half565 = vxgfx::pf_rgb565_t(0, 0, 0).blend(vxgfx::pf_rgb565_t(0xff, 0xff, 0xff), 0.5f);
+    REQUIRE(half565.value == vxgfx::pf_rgb565_t(180, 180, 180).value);
+}
+
+TEST_CASE("GFXUtil ARGBToRGB565", "[gfxutil]") {
+    REQUIRE(vxgfx::pf_rgb565_t(vxgfx::pf_argb_t(0xff, 0xff, 0x80, 0x00)).value ==
+            vxgfx::pf_rgb565_t(0xff, 0x80, 0x00).value);
+    // premultiplied by the alpha
+    REQUIRE(vxgfx::pf_rgb565_t(vxgfx::pf_argb_t(0x80, 0xff, 0xff, 0xff)).value ==
+            vxgfx::pf_rgb565_t(0x80, 0x80, 0x80).value);
+}
+
+TEST_CASE("GFXUtil BlendSpan", "[gfxutil]") {
+    std::array<vxgfx::pf_rgb565_t, 3> dst{};
+    const std::array<vxgfx::pf_argb_t, 3> src{
+        vxgfx::pf_argb_t(0x00, 0xff, 0xff, 0xff),
+        vxgfx::pf_argb_t(0xff, 0xff, 0x00, 0x00),
+        vxgfx::pf_argb_t(0x80, 0x00, 0xff, 0x00),
+    };
+
+    vxgfx::blend_span(dst.data(), src.data(), dst.size());
+
+    REQUIRE(dst[0].value == 0);
+    REQUIRE(dst[1].value == vxgfx::pf_rgb565_t(0xff, 0x00, 0x00).value);
+    REQUIRE(dst[2].r8() == 0);
+    REQUIRE(dst[2].g8() > 0x80);
+}
+
+TEST_CASE("GFXUtil OverlayComposite", "[gfxutil]") {
+    vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t> src{32, 16, vxgfx::pf_mono_t(1.0f)};
+    vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> dst{32, 16};
+    vxgfx::overlay_buffer<vxgfx::pf_argb_t> overlay{32, 16};
+    const vxgfx::mono_lut<vxgfx::pf_argb_t> lut{};
+    const auto red = vxgfx::pf_argb_t(0xff, 0xff, 0x00, 0x00);
+
+    overlay.begin_frame();
+    overlay.plot_pixel(9, 2, vxgfx::m_direct(), red);
+    REQUIRE(overlay.covered(15, 7));
+    REQUIRE_FALSE(overlay.covered(16, 7));
+    REQUIRE_FALSE(overlay.covered(9, 8));
+
+    vxgfx::convert_mono(dst, src, lut, overlay, dst.rect());
+    REQUIRE(dst.get_pixel(9, 2).value == red.value);
+    REQUIRE(dst.get_pixel(10, 2).value == lut[255].value);
+
+    // the next frame clears the text and the area it covered has to be converted again
+    overlay.begin_frame();
+    REQUIRE(overlay.get_pixel(9, 2).value == 0);
+    vxgfx::dirty_region region{};
+    overlay.add_changed(region);
+    REQUIRE(region.begin() != region.end());
+    REQUIRE(vxgfx::intersect(*region.begin(), vxgfx::rect_t{vxgfx::point_t{9, 2}, vxgfx::point_t{10, 3}}));
+
+    vxgfx::convert_mono(dst, src, lut, overlay, *region.begin());
+    REQUIRE(dst.get_pixel(9, 2).value == lut[255].value);
+}
+
+TEST_CASE("GFXUtil GlyphAtlas", "[gfxutil]") {
+    const auto c = vxgfx::pf_argb_t(0xff, 0x00, 0xff, 0x00);
+    const vxgfx::glyph_atlas<vxgfx::pf_argb_t> atlas{c};
+    vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> plotted{40, 12};
+    vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> blitted{40, 12};
+
+    // partly off the left and bottom edges, the spans are clipped
+    vxgfx::draw_text<vxgfx::m_direct>(plotted, -3, 6, c, "A#q w");
+    vxgfx::draw_text(blitted, -3, 6, atlas, "A#q w");
+
+    REQUIRE(std::equal(plotted.begin(), plotted.end(), blitted.begin(),
+                       [](const auto &a, const auto &b) { return a.value == b.value; }));
+    REQUIRE(std::any_of(blitted.begin(), blitted.end(), [&c](const auto &p) { return p.value == c.value; }));
+}
+
+TEST_CASE("GFXUtil FormatTo", "[gfxutil]") {
+    char buffer[8];
+    REQUIRE(vxl::format_to(buffer, "%d Hz", 50) == "50 Hz");
+    // truncated to fit the buffer
+    REQUIRE(vxl::format_to(buffer, "%d", 123456789) == "1234567");
+}
+
+TEST_CASE("GFXUtil TintMap", "[gfxutil]") {
+    // left half red, right half white
+    vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> image{2, 1};
+    image.data()[0] = vxgfx::pf_argb_t(0xff, 0x00, 0x00);
+    image.data()[1] = vxgfx::pf_argb_t(0xff, 0xff, 0xff);
+
+    vxgfx::tint_map tint;
+    tint.build(image, 8, 4);
+    REQUIRE(tint.get_pixel(0, 0).value == image.data()[0].value);
+    REQUIRE(tint.get_pixel(7, 3).value == image.data()[1].value);
+
+    vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t> src{8, 4, vxgfx::pf_mono_t(0.5f)};
+    vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> dst{8, 4};
+    const vxgfx::mono_lut<vxgfx::pf_argb_t> lut{};
+    vxgfx::convert_mono(dst, src, tint, dst.rect());
+
+    // a white tint is the same as the grayscale output
+    REQUIRE(dst.get_pixel(7, 0).value == lut[vxgfx::quantize(src.get_pixel(7, 0))].value);
+    REQUIRE(dst.get_pixel(0, 0).value == vxgfx::pf_argb_t(vxgfx::quantize(src.get_pixel(0, 0)), 0, 0).value);
+    REQUIRE(vxgfx::mul_c8(255, 0x80) == 0x80);
+    REQUIRE(vxgfx::mul_c8(0, 0xff) == 0);
+}
+
+TEST_CASE("GFXUtil AntialiasedLine", "[gfxutil]") {
+    constexpr int S = vxgfx::AA_SUBPIXEL;
+    vxgfx::dynamic_framebuffer<vxgfx::pf_mono_t> fb{8, 8};
+
+    // on the pixel centres, one pixel per column
+    vxgfx::draw_aline<vxgfx::m_max>(fb, S / 2, 2 * S + S / 2, 7 * S + S / 2, 2 * S + S / 2, vxgfx::pf_mono_t(1.0f));
+    REQUIRE(fb.get_pixel(4, 2).value == 1.0f);
+    REQUIRE(fb.get_pixel(4, 1).value == 0.0f);
+    REQUIRE(fb.get_pixel(4, 3).value == 0.0f);
+
+    // half way between two rows, split between them
+    fb.clear();
+    vxgfx::draw_aline<vxgfx::m_max>(fb, S / 2, 5 * S, 7 * S + S / 2, 5 * S, vxgfx::pf_mono_t(1.0f));
+    REQUIRE(fb.get_pixel(3, 4).value == 0.5f);
+    REQUIRE(fb.get_pixel(3, 5).value == 0.5f);
+
+    // the brightest line wins where lines cross
+    vxgfx::draw_aline<vxgfx::m_max>(fb, 3 * S + S / 2, 0, 3 * S + S / 2, 7 * S, vxgfx::pf_mono_t(0.25f));
+    REQUIRE(fb.get_pixel(3, 4).value == 0.5f);
+    REQUIRE(fb.get_pixel(3, 1).value == 0.25f);
+}
@@ -0,0 +1,76 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include "governor.h"
+
+static QualityGovernor make_governor()
+{
+    QualityGovernor governor;
+    governor.SetMaximum({ true, GLOW_HIGH, 4 });
+    governor.SetBudget(4000);
+    return governor;
+}
+
+// Feed frames of the same render time, returns the number of quality changes
+static int run(QualityGovernor &governor, int frames, int64_t frame_us)
+{
+    int changes = 0;
+    for (int i = 0; i < frames; i++)
+        changes += governor.Update(frame_us);
+    return changes;
+}
+
+TEST_CASE("Governor StepsDownOverBudget", "[governor]") {
+    auto governor = make_governor();
+    REQUIRE(governor.current().supersample == 4);
+
+    // the first step down waits for the hold and a run of slow frames
+    REQUIRE(run(governor, QualityGovernor::HOLD_FRAMES, 10000) == 0);
+    REQUIRE(run(governor, QualityGovernor::DOWN_FRAMES, 10000) == 1);
+    REQUIRE(governor.current().supersample == 2);
+
+    // supersampling, then glow, then antialiasing, and then there is nothing left to drop
+    run(governor, 1000, 10000);
+    REQUIRE(governor.current().supersample == 1);
+    REQUIRE(governor.current().glow == GLOW_OFF);
+    REQUIRE_FALSE(governor.current().antialias);
+    REQUIRE(governor.level() == 5);
+}
+
+TEST_CASE("Governor Hysteresis", "[governor]") {
+    auto governor = make_governor();
+    run(governor, 100, 10000);
+    const auto level = governor.level();
+    REQUIRE(level > 0);
+
+    // frames just under the budget are not enough to step back up
+    REQUIRE(run(governor, 1000, 3500) == 0);
+
+    // a long run of fast frames steps up one level at a time
+    REQUIRE(run(governor, QualityGovernor::HOLD_FRAMES + QualityGovernor::UP_FRAMES, 1000) == 1);
+    REQUIRE(governor.level() == level - 1);
+}
+
+TEST_CASE("Governor Disabled", "[governor]") {
+    auto governor = make_governor();
+    governor.SetBudget(0);
+    REQUIRE(run(governor, 1000, 100000) == 0);
+    REQUIRE(governor.level() == 0);
+}
@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include <thread>
+#include "ring.h"
+
+TEST_CASE("Ring Wrap", "[ring]")
+{
+    vxl::spsc_ring<int> ring(6);
+    REQUIRE(ring.capacity() == 8);
+
+    int data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    int out[8] = {};
+    REQUIRE(ring.write(data, 6) == 6);
+    REQUIRE(ring.read(out, 4) == 4);
+    REQUIRE(out[3] == 4);
+
+    // only the free space is written, and it wraps around the end
+    REQUIRE(ring.write(data, 8) == 6);
+    REQUIRE(ring.size() == 8);
+
+    size_t span;
+    ring.read_span(span);
+    REQUIRE(span == 4);
+    REQUIRE(ring.read(out, 8) == 8);
+    const int expected[8] = { 5, 6, 1, 2, 3, 4, 5, 6 };
+    REQUIRE(std::equal(out, out + 8, expected));
+    REQUIRE(ring.size() == 0);
+    REQUIRE(ring.read(out, 1) == 0);
+
+    // clearing drops what was not read, the whole ring is free again
+    REQUIRE(ring.write(data, 5) == 5);
+    ring.clear();
+    REQUIRE(ring.size() == 0);
+    REQUIRE(ring.write(data, 8) == 8);
+    REQUIRE(ring.read(out, 8) == 8);
+    REQUIRE(std::equal(out, out + 8, data));
+}
+
+TEST_CASE("Ring Threads", "[ring]")
+{
+    vxl::spsc_ring<uint32_t> ring(256);
+    const uint32_t count = 1000000;
+
+    std::thread producer([&ring, count] {
+        uint32_t next = 0;
+        while (next < count)
+        {
+            size_t span;
+            uint32_t *dst = ring.write_span(span);
+            span = std::min<size_t>(span, count - next);
+            for (size_t i = 0; i < span; i++)
+                dst[i] = next++;
+            ring.commit(span);
+        }
+    });
+
+    // the items arrive in order and none are lost
+    uint32_t expected = 0;
+    bool ordered = true;
+    while (expected < count)
+    {
+        uint32_t out[64];
+        const auto n = ring.read(out, 64);
+        for (size_t i = 0; i < n; i++)
+            ordered = ordered && out[i] == expected++;
+    }
+    producer.join();
+    REQUIRE(ordered);
+    REQUIRE(ring.size() == 0);
+}
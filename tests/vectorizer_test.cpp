@@ -0,0 +1,269 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "vectorizer.h"
+
+// every heap allocation made by the test binary, including the ones in the library, is counted
+static std::atomic<size_t> allocations{0};
+
+void *operator new(std::size_t size)
+{
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// Drive the vectorizer with a 30000 cycle frame that draws a line every 1000 cycles, or moves the beam the same
+// way with it turned off
+static void run_frame(Vectorizer &vectorizer, bool beam = true)
+{
+    for (int cycle = 0; cycle < 30000; cycle++) {
+        auto phase = cycle % 1000;
+        auto line = static_cast<uint8_t>(cycle / 1000);
+
+        if (phase < 10)        // brightness sample and hold, ramp off
+            vectorizer.Step(0x7f, 0x84, 1, 0);
+        else if (phase < 20)   // y axis sample and hold
+            vectorizer.Step(line * 4, 0x80, 1, 0);
+        else if (phase < 500)  // x axis, ramp on and beam on
+            vectorizer.Step(0x40, 0x01, 1, beam);
+        else if (phase < 990)  // ramp off and beam off
+            vectorizer.Step(0x00, 0x81, 1, 0);
+        else                   // zero the integrators
+            vectorizer.Step(0x00, 0x81, 0, 0);
+    }
+}
+
+TEST_CASE("Vectorizer DrawsVectors", "[vectorizer]") {
+    auto vectorizer = std::make_unique<Vectorizer>();
+
+    run_frame(*vectorizer);
+    auto fb = vectorizer->getVectorBuffer();
+
+    REQUIRE_FALSE(vectorizer->getDirtyRegion().empty());
+    REQUIRE(std::any_of(fb->begin(), fb->end(), [](const vxgfx::pf_mono_t &p) { return p.value > 0.0f; }));
+}
+
+TEST_CASE("Vectorizer NoAllocationsAfterWarmup", "[vectorizer]") {
+    auto vectorizer = std::make_unique<Vectorizer>();
+
+    for (int frame = 0; frame < 10; frame++) {
+        const size_t before = allocations;
+        run_frame(*vectorizer);
+        vectorizer->getVectorBuffer();
+        const size_t count = allocations - before;
+
+        if (frame >= 3) {
+            REQUIRE(count == 0);
+            REQUIRE(vectorizer->getFrameAllocations() == 0);
+        }
+    }
+}
+
+TEST_CASE("Vectorizer DisplayList", "[vectorizer]") {
+    auto vectorizer = std::make_unique<Vectorizer>();
+
+    run_frame(*vectorizer);
+    const auto &display_list = vectorizer->getDisplayList();
+
+    // one segment per line, drawn left to right
+    REQUIRE(display_list.size() == 30);
+    for (const auto &segment: display_list) {
+        REQUIRE(segment.x1 > segment.x0);
+        REQUIRE(segment.intensity > 0.0f);
+        REQUIRE(segment.end_cycle > segment.start_cycle);
+    }
+
+    // collecting the display list does not decay the vectors a second time
+    auto intensity = display_list.front().intensity;
+    auto data = display_list.data();
+    vectorizer->getVectorBuffer();
+    REQUIRE(vectorizer->getDisplayList().front().intensity == intensity);
+    REQUIRE(vectorizer->getDisplayList().data() == data);
+}
+
+TEST_CASE("Vectorizer Glow", "[vectorizer]") {
+    auto plain = std::make_unique<Vectorizer>();
+    auto glowing = std::make_unique<Vectorizer>();
+    glowing->SetGlow(GLOW_HIGH);
+
+    run_frame(*plain);
+    run_frame(*glowing);
+    auto fb = plain->getVectorBuffer();
+    auto gb = glowing->getVectorBuffer();
+
+    REQUIRE(gb != fb);
+    REQUIRE(gb->width == fb->width);
+    REQUIRE(gb->height == fb->height);
+
+    // the glow only adds light, and some of it lands on pixels the beam did not draw
+    bool brighter = true, spread = false;
+    for (size_t i = 0; i < fb->size(); i++) {
+        brighter &= gb->data()[i].value >= fb->data()[i].value;
+        spread |= fb->data()[i].value == 0.0f && gb->data()[i].value > 0.0f;
+    }
+    REQUIRE(brighter);
+    REQUIRE(spread);
+
+    // turning the glow off returns the plain buffer again
+    glowing->SetGlow(GLOW_OFF);
+    run_frame(*glowing);
+    REQUIRE(glowing->getVectorBuffer() != gb);
+}
+
+// FNV-1a over the bits of the intensities
+static uint64_t hash_buffer(const VectorBuffer &buffer)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const auto &p : buffer) {
+        uint32_t bits;
+        std::memcpy(&bits, &p.value, sizeof(bits));
+        for (int i = 0; i < 4; i++)
+            hash = (hash ^ ((bits >> (i * 8)) & 0xff)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+TEST_CASE("Vectorizer SkipFrame", "[vectorizer]") {
+    auto skipping = std::make_unique<Vectorizer>();
+    auto drawing = std::make_unique<Vectorizer>();
+
+    // start with a frame drawn with the beam off, so the buffer is black
+    run_frame(*skipping, false);
+    const auto buffer = skipping->getVectorBuffer();
+    run_frame(*drawing, false);
+    drawing->getVectorBuffer();
+
+    // nothing is drawn for a skipped frame
+    run_frame(*skipping);
+    skipping->SkipFrame();
+    REQUIRE(std::all_of(buffer->begin(), buffer->end(), [](const vxgfx::pf_mono_t &p) { return p.value == 0.0f; }));
+
+    run_frame(*drawing);
+    const auto intensity = drawing->getDisplayList().front().intensity;
+    drawing->getVectorBuffer();
+
+    // the lines keep fading while frames are skipped, the next drawn frame is the same as if every frame was drawn
+    run_frame(*skipping, false);
+    run_frame(*drawing, false);
+    REQUIRE(skipping->getDisplayList().front().intensity < intensity);
+    REQUIRE(skipping->getDisplayList().front().intensity == drawing->getDisplayList().front().intensity);
+    REQUIRE(hash_buffer(*skipping->getVectorBuffer()) == hash_buffer(*drawing->getVectorBuffer()));
+}
+
+TEST_CASE("Vectorizer DirtyRegion", "[vectorizer]") {
+    auto incremental = std::make_unique<Vectorizer>();
+    auto reference = std::make_unique<Vectorizer>();
+
+    // the lines of the first frame have faded out two frames later
+    incremental->decay_cycles = reference->decay_cycles = 5000;
+
+    SECTION("Native") {}
+    SECTION("Supersampled") {
+        incremental->SetResolution(1, 2);
+        reference->SetResolution(1, 2);
+    }
+
+    // the first frame is drawn in full, the next one drawn only where the lines of the first were
+    run_frame(*incremental);
+    const auto first = *incremental->getVectorBuffer();
+    vxgfx::dynamic_framebuffer<vxgfx::pf_rgb565_t> out(first.width, first.height);
+    const vxgfx::mono_lut<vxgfx::pf_rgb565_t> lut{};
+    for (const auto &r : incremental->getDirtyRegion())
+        vxgfx::convert_mono(out, first, lut, r);
+
+    run_frame(*incremental, false);
+    incremental->SkipFrame();
+    run_frame(*incremental, false);
+    const auto second = incremental->getVectorBuffer();
+    const auto &changed = incremental->getDirtyRegion();
+    REQUIRE_FALSE(changed.empty());
+    for (const auto &r : changed)
+        vxgfx::convert_mono(out, *second, lut, r);
+
+    // the reference skips the first frames, so the last is drawn in full
+    run_frame(*reference);
+    reference->SkipFrame();
+    run_frame(*reference, false);
+    reference->SkipFrame();
+    run_frame(*reference, false);
+    const auto full = reference->getVectorBuffer();
+    vxgfx::dynamic_framebuffer<vxgfx::pf_rgb565_t> full_out(full->width, full->height);
+    vxgfx::convert_mono(full_out, *full, lut);
+
+    // inside the changed areas the pixels are updated, outside them they are left as they were
+    size_t updated = 0, stale = 0, outside = 0, kept = 0, wrong = 0;
+    for (int y = 0; y < full->height; y++) {
+        for (int x = 0; x < full->width; x++) {
+            const auto i = static_cast<size_t>(y) * full->width + x;
+            bool inside = false;
+            for (const auto &r : changed)
+                inside |= x >= r.left && x < r.right && y >= r.top && y < r.bottom;
+            stale += second->data()[i].value != full->data()[i].value;
+            wrong += out.data()[i].value != full_out.data()[i].value;
+            if (inside) {
+                updated += second->data()[i].value != first.data()[i].value;
+            } else {
+                outside++;
+                kept += second->data()[i].value == first.data()[i].value;
+            }
+        }
+    }
+    REQUIRE(stale == 0);
+    REQUIRE(wrong == 0);
+    REQUIRE(updated > 0);
+    REQUIRE(outside > 0);
+    REQUIRE(kept == outside);
+}
+
+TEST_CASE("Vectorizer GoldenFrame", "[vectorizer]") {
+    // the beam model is fixed point, so a frame is bit-identical whatever the compiler, optimization or platform
+    auto vectorizer = std::make_unique<Vectorizer>();
+
+    SECTION("Lines") {
+        for (int frame = 0; frame < 3; frame++)
+            run_frame(*vectorizer);
+        REQUIRE(hash_buffer(*vectorizer->getVectorBuffer()) == 0x9d885f213d46b8c2ull);
+    }
+
+    SECTION("Antialiased and supersampled") {
+        vectorizer->SetResolution(2, 2);
+        vectorizer->SetAntialias(true);
+        for (int frame = 0; frame < 3; frame++)
+            run_frame(*vectorizer);
+        REQUIRE(hash_buffer(*vectorizer->getVectorBuffer()) == 0xb0bf960bff18d3d9ull);
+    }
+}
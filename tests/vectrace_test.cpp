@@ -0,0 +1,197 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <random>
+#include "vectrace.h"
+
+// The segments of frame n, the positions are whole trace units so they are stored exactly
+static DisplayList make_frame(uint32_t n, uint64_t frame_cycle)
+{
+    DisplayList segments;
+    for (uint32_t i = 0; i < n % 5 + 1; i++) {
+        const float unit = 1.0f / vectrace::POSITION_PER_VOLT;
+        vector_segment_t s{};
+        s.x0 = static_cast<float>(static_cast<int>(i * 100) - 200) * unit;
+        s.y0 = static_cast<float>(static_cast<int>(n * 7) - 300) * unit;
+        s.x1 = s.x0 + static_cast<float>(i * 50 + 1) * unit;
+        s.y1 = s.y0 - static_cast<float>(n % 13) * unit;
+        s.intensity = static_cast<float>(65536 - i * 4096) / 65536.0f;
+        s.start_cycle = frame_cycle + i * 1000;
+        s.end_cycle = s.start_cycle + 500;
+        segments.push_back(s);
+    }
+    return segments;
+}
+
+TEST_CASE("Vectrace Varint", "[vectrace]") {
+    const uint64_t values[] = { 0, 1, 127, 128, 300, 16383, 16384, 1ull << 35,
+                                std::numeric_limits<uint64_t>::max() };
+    const int64_t signed_values[] = { 0, 1, -1, 63, -64, 64, -65, 1000000, -1000000,
+                                      std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max() };
+
+    std::vector<uint8_t> data;
+    for (auto v : values)
+        vectrace::put_varint(data, v);
+    for (auto v : signed_values)
+        vectrace::put_zigzag(data, v);
+
+    size_t pos = 0;
+    for (auto v : values) {
+        uint64_t u;
+        REQUIRE(vectrace::get_varint(data, pos, u));
+        REQUIRE(u == v);
+    }
+    for (auto v : signed_values) {
+        int64_t s;
+        REQUIRE(vectrace::get_zigzag(data, pos, s));
+        REQUIRE(s == v);
+    }
+    REQUIRE(pos == data.size());
+
+    // small values are one byte, whatever their sign
+    data.clear();
+    vectrace::put_zigzag(data, -64);
+    REQUIRE(data.size() == 1);
+
+    // a value cut off at the end of the input is an error
+    data.clear();
+    vectrace::put_varint(data, 1ull << 20);
+    data.pop_back();
+    pos = 0;
+    uint64_t u;
+    REQUIRE_FALSE(vectrace::get_varint(data, pos, u));
+}
+
+TEST_CASE("Vectrace LZ", "[vectrace]") {
+    // repeats with literals in between, and a long run that needs the extended lengths
+    std::vector<uint8_t> src;
+    for (int i = 0; i < 200; i++) {
+        const char *text = "the beam moves from one end of the line to the other ";
+        src.insert(src.end(), text, text + std::strlen(text));
+        src.push_back(static_cast<uint8_t>(i));
+    }
+    src.insert(src.end(), 1000, 0x55);
+
+    std::vector<uint8_t> packed;
+    const auto size = vectrace::lz_compress(src.data(), src.size(), packed);
+    REQUIRE(size > 0);
+    REQUIRE(size < src.size() / 4);
+
+    std::vector<uint8_t> out(src.size());
+    REQUIRE(vectrace::lz_decompress(packed.data(), size, out.data(), out.size()));
+    REQUIRE(out == src);
+
+    SECTION("Corrupt") {
+        // the wrong size, a truncated input and a match before the start of the output are errors
+        REQUIRE_FALSE(vectrace::lz_decompress(packed.data(), size, out.data(), out.size() - 1));
+        REQUIRE_FALSE(vectrace::lz_decompress(packed.data(), size / 2, out.data(), out.size()));
+        const uint8_t bad[] = { 0x10, 'a', 0x10, 0x00 };
+        REQUIRE_FALSE(vectrace::lz_decompress(bad, sizeof(bad), out.data(), 6));
+    }
+
+    SECTION("Incompressible") {
+        std::mt19937 rng(1);
+        std::vector<uint8_t> noise(4096);
+        for (auto &b : noise)
+            b = static_cast<uint8_t>(rng());
+        REQUIRE(vectrace::lz_compress(noise.data(), noise.size(), packed) == 0);
+    }
+}
+
+TEST_CASE("Vectrace RoundTrip", "[vectrace]") {
+    const auto filename = (std::filesystem::temp_directory_path() / "vectrace_test.vxtr").string();
+    const uint32_t frames = 100;
+    const bool compress = GENERATE(true, false);
+
+    {
+        vectrace::TraceWriter writer;
+        writer.chunk_frames = 32;
+        REQUIRE(writer.open(filename, compress));
+        for (uint32_t n = 0; n < frames; n++) {
+            // the segments of the previous frame are still visible, they are not written again
+            auto segments = make_frame(n, n * 30000ull);
+            if (n > 0) {
+                auto previous = make_frame(n - 1, (n - 1) * 30000ull);
+                segments.insert(segments.begin(), previous.begin(), previous.end());
+            }
+            writer.add_frame((n + 1) * 30000ull, segments);
+        }
+        REQUIRE(writer.close());
+    }
+
+    vectrace::TraceReader reader;
+    REQUIRE(reader.open(filename));
+    REQUIRE(reader.frame_count() == frames);
+
+    auto same = [](const DisplayList &a, const DisplayList &b) {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].x0 != b[i].x0 || a[i].y0 != b[i].y0 || a[i].x1 != b[i].x1 || a[i].y1 != b[i].y1 ||
+                a[i].intensity != b[i].intensity || a[i].start_cycle != b[i].start_cycle ||
+                a[i].end_cycle != b[i].end_cycle)
+                return false;
+        }
+        return true;
+    };
+
+    DisplayList segments;
+    uint32_t frame;
+    uint64_t cycle;
+    uint32_t read = 0;
+    bool all_same = true;
+    while (reader.next(frame, cycle, segments)) {
+        all_same = all_same && frame == read && cycle == (read + 1) * 30000ull &&
+                   same(segments, make_frame(read, read * 30000ull));
+        read++;
+    }
+    REQUIRE(read == frames);
+    REQUIRE(all_same);
+
+    // seeking starts at a chunk boundary, the chunk before is read too if the history the frame needs reaches it
+    REQUIRE(reader.seek(70, 0));
+    REQUIRE(reader.next(frame, cycle, segments));
+    REQUIRE(frame == 64);
+    REQUIRE(same(segments, make_frame(64, 64 * 30000ull)));
+    REQUIRE(reader.seek(70, 40000));
+    REQUIRE(reader.next(frame, cycle, segments));
+    REQUIRE(frame == 32);
+    REQUIRE(same(segments, make_frame(32, 32 * 30000ull)));
+    REQUIRE_FALSE(reader.seek(frames, 0));
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Vectrace WriteError", "[vectrace]") {
+    // nothing can be written to a full device, closing reports the lost chunks
+    if (!std::filesystem::exists("/dev/full"))
+        return;
+
+    vectrace::TraceWriter writer;
+    writer.chunk_frames = 4;
+    REQUIRE(writer.open("/dev/full", false));
+    for (uint32_t n = 0; n < 100; n++)
+        writer.add_frame((n + 1) * 30000ull, make_frame(n, n * 30000ull));
+    REQUIRE_FALSE(writer.close());
+}
@@ -0,0 +1,129 @@
+/*
+Copyright (C) 2016-2024 Team Vectrexia
+
+This file is part of Vectrexia.
+
+Vectrexia is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Vectrexia is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Vectrexia. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <catch2/catch_all.hpp>
+#include <array>
+#include <memory>
+#include <vectrexia.h>
+
+// Load a program at the start of the cartridge and jump to it, skipping the BIOS
+static std::unique_ptr<Vectrex> run_program(std::initializer_list<uint8_t> program)
+{
+    std::array<uint8_t, 0x8000> rom{};
+    std::copy(program.begin(), program.end(), rom.begin());
+
+    auto vectrex = std::make_unique<Vectrex>();
+    vectrex->LoadCartridge(rom.data(), rom.size());
+    vectrex->Reset();
+    vectrex->GetM6809().getRegisters().PC = 0x0000;
+    return vectrex;
+}
+
+TEST_CASE("Vectrex RunFrame", "[vectrex]") {
+    // the frame loop of Wait_Recal: start timer 2, wait for it to expire and start it again
+    auto vectrex = run_program({
+        0x86, 0x30,             // 0000 start: LDA #$30
+        0xb7, 0xd0, 0x08,       // 0002        STA $D008    T2 low, 30000 cycles
+        0x86, 0x75,             // 0005        LDA #$75
+        0xb7, 0xd0, 0x09,       // 0007        STA $D009    T2 high, starts the timer
+        0xb6, 0xd0, 0x0d,       // 000A wait:  LDA $D00D    IFR
+        0x85, 0x20,             // 000D        BITA #$20    timer 2 expired
+        0x27, 0xf9,             // 000F        BEQ wait
+        0x20, 0xed,             // 0011        BRA start
+        0x20, 0xfe,             // 0013 stop:  BRA stop
+    });
+
+    // the first write of T2 high is not a sync, timer 2 had not expired
+    auto cycles = vectrex->RunFrame(60000);
+    REQUIRE(vectrex->FrameSynced());
+    REQUIRE(cycles > 29950);
+    REQUIRE(cycles < 30050);
+
+    // each frame ends at the write of T2 high after the timer expired, the period of timer 2 give or take the loop
+    for (int frame = 0; frame < 5; frame++) {
+        cycles = vectrex->RunFrame(60000);
+        REQUIRE(vectrex->FrameSynced());
+        REQUIRE(cycles > 29950);
+        REQUIRE(cycles < 30050);
+    }
+
+    // a game that stops syncing runs for the whole budget
+    vectrex->GetM6809().getRegisters().PC = 0x0013;
+    cycles = vectrex->RunFrame(30000);
+    REQUIRE_FALSE(vectrex->FrameSynced());
+    REQUIRE(cycles >= 30000);
+    REQUIRE(cycles < 30010);
+}
+
+// Write a PSG register the way the BIOS does, the VIA drives the bus with port A and BDIR/BC1 with PB4/PB3
+static void psg_write(Vectrex &vectrex, uint8_t reg, uint8_t value)
+{
+    vectrex.Write(0xd001, reg);     // ORA, the register number
+    vectrex.Write(0xd000, 0x19);    // ORB, BDIR and BC1: latch the address
+    vectrex.Write(0xd000, 0x01);    // ORB, inactive
+    vectrex.Write(0xd001, value);   // ORA, the value
+    vectrex.Write(0xd000, 0x11);    // ORB, BDIR: write
+    vectrex.Write(0xd000, 0x01);    // ORB, inactive
+}
+
+// Read a PSG register, it is stored in the port A latch and read back through ORA
+static uint8_t psg_read(Vectrex &vectrex, uint8_t reg)
+{
+    vectrex.Write(0xd003, 0xff);    // DDRA, port A drives the bus
+    vectrex.Write(0xd001, reg);
+    vectrex.Write(0xd000, 0x19);
+    vectrex.Write(0xd000, 0x01);
+    vectrex.Write(0xd003, 0x00);    // DDRA, the PSG drives the bus
+    vectrex.Write(0xd000, 0x09);    // ORB, BC1: read
+    const auto value = vectrex.Read(0xd001);
+    vectrex.Write(0xd000, 0x01);
+    vectrex.Write(0xd003, 0xff);
+    return value;
+}
+
+TEST_CASE("Vectrex PSG Bus", "[vectrex]") {
+    auto vectrex = std::make_unique<Vectrex>();
+    vectrex->Reset();
+    vectrex->Write(0xd002, 0x9f);   // DDRB, as the BIOS sets it
+    vectrex->Write(0xd003, 0xff);   // DDRA
+
+    psg_write(*vectrex, 0, 0x42);
+    psg_write(*vectrex, 1, 0x01);
+    psg_write(*vectrex, 8, 0x0f);
+    REQUIRE(vectrex->psg_->channel_a.period_ == 0x142);
+    REQUIRE(vectrex->psg_->channel_a.amplitude_fixed == 0x0f);
+
+    // the value is the same as the register number, port A does not change between the latch and the write
+    psg_write(*vectrex, 9, 0x09);
+    REQUIRE(vectrex->psg_->channel_b.amplitude_fixed == 0x09);
+
+    REQUIRE(psg_read(*vectrex, 0) == 0x42);
+    REQUIRE(vectrex->ReadPortA() == 0x42);
+    REQUIRE(psg_read(*vectrex, 1) == 0x01);
+    REQUIRE(psg_read(*vectrex, 9) == 0x09);
+    REQUIRE(vectrex->ReadPortA() == 0x09);
+
+    // without BDIR or BC1 nothing is latched or written
+    vectrex->Write(0xd001, 0x00);
+    vectrex->Write(0xd000, 0x01);
+    vectrex->Write(0xd001, 0x55);
+    vectrex->Write(0xd000, 0x00);
+    REQUIRE(vectrex->psg_->channel_b.amplitude_fixed == 0x09);
+    REQUIRE(psg_read(*vectrex, 0) == 0x42);
+}
@@ -0,0 +1,182 @@
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include "audiowriter.h"
+
+namespace vectaudio {
+
+namespace {
+
+const size_t WAV_HEADER_SIZE = 44;
+// the frames written at once by the writer thread
+const size_t WRITE_FRAMES = 4096;
+
+void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t) (v >> (i * 8));
+}
+
+// the canonical 44 byte header of a PCM WAV file
+void wav_header(uint8_t *header, unsigned channels, unsigned rate, uint32_t data_bytes)
+{
+    std::memcpy(header, "RIFF", 4);
+    put_u32(header + 4, (uint32_t) (WAV_HEADER_SIZE - 8 + data_bytes));
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    put_u32(header + 16, 16);
+    put_u16(header + 20, 1);
+    put_u16(header + 22, (uint16_t) channels);
+    put_u32(header + 24, rate);
+    put_u32(header + 28, rate * channels * 2);
+    put_u16(header + 32, (uint16_t) (channels * 2));
+    put_u16(header + 34, 16);
+    std::memcpy(header + 36, "data", 4);
+    put_u32(header + 40, data_bytes);
+}
+
+}
+
+AudioWriter::~AudioWriter()
+{
+    close();
+}
+
+bool AudioWriter::open(const std::vector<std::string> &filenames, unsigned channels, unsigned rate, format_t format)
+{
+    close();
+    format_ = format;
+    channels_ = std::max(channels, 1u);
+    rate_ = rate;
+
+    for (const auto &filename : filenames)
+    {
+        FILE *file = std::fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            close();
+            return false;
+        }
+        outputs_.push_back(output_t{ file, 0 });
+
+        // the sizes are not known yet, they are filled in on close
+        uint8_t header[WAV_HEADER_SIZE];
+        wav_header(header, channels_, rate_, 0);
+        if (format_ == FORMAT_WAV && std::fwrite(header, sizeof(header), 1, file) != 1)
+        {
+            close();
+            return false;
+        }
+    }
+
+    frame_size_ = outputs_.size() * channels_;
+    ring_ = std::make_unique<vxl::spsc_ring<int16_t>>(buffer_frames * frame_size_);
+    samples_.resize(WRITE_FRAMES * frame_size_);
+    bytes_.resize(WRITE_FRAMES * channels_ * 2);
+    done_ = false;
+    failed_ = false;
+    thread_ = std::thread(&AudioWriter::run, this);
+    return true;
+}
+
+bool AudioWriter::is_open() const
+{
+    return !outputs_.empty();
+}
+
+void AudioWriter::write(const int16_t *frames, size_t count)
+{
+    if (!thread_.joinable())
+        return;
+
+    size_t written = 0;
+    const size_t size = count * frame_size_;
+    for (;;)
+    {
+        written += ring_->write(frames + written, size - written);
+        wake_.notify_one();
+        if (written == size)
+            break;
+        // the writer has fallen a whole ring behind, there is nothing to do but wait for it
+        std::this_thread::yield();
+    }
+}
+
+void AudioWriter::drain()
+{
+    for (;;)
+    {
+        // whole frames only, a frame can be split by the end of the ring
+        const size_t frames = std::min(ring_->size() / frame_size_, WRITE_FRAMES);
+        if (!frames)
+            break;
+        ring_->read(samples_.data(), frames * frame_size_);
+
+        for (size_t o = 0; o < outputs_.size(); o++)
+        {
+            auto &output = outputs_[o];
+            const int16_t *src = samples_.data() + o * channels_;
+            uint8_t *dst = bytes_.data();
+            for (size_t f = 0; f < frames; f++, src += frame_size_)
+                for (unsigned c = 0; c < channels_; c++, dst += 2)
+                    put_u16(dst, (uint16_t) src[c]);
+
+            // only what was written is counted, so the header matches the file after a failed write
+            const size_t bytes = dst - bytes_.data();
+            const size_t written = std::fwrite(bytes_.data(), 1, bytes, output.file);
+            if (written != bytes)
+                failed_ = true;
+            output.data_bytes += (uint32_t) written;
+        }
+    }
+}
+
+void AudioWriter::run()
+{
+    for (;;)
+    {
+        // anything written before done was set is drained before stopping
+        const bool done = done_;
+        drain();
+        if (done)
+            break;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+bool AudioWriter::close()
+{
+    if (thread_.joinable())
+    {
+        done_ = true;
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    // the header is patched even if a write failed, so the samples that were written can still be played
+    bool ok = !failed_;
+    for (auto &output : outputs_)
+    {
+        if (format_ == FORMAT_WAV)
+        {
+            uint8_t header[WAV_HEADER_SIZE];
+            wav_header(header, channels_, rate_, output.data_bytes);
+            if (std::fseek(output.file, 0, SEEK_SET) != 0 || std::fwrite(header, sizeof(header), 1, output.file) != 1)
+                ok = false;
+        }
+        if (std::fclose(output.file) != 0)
+            ok = false;
+    }
+    outputs_.clear();
+    ring_.reset();
+    return ok;
+}
+
+}
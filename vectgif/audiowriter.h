@@ -0,0 +1,81 @@
+#ifndef VECTGIF_AUDIOWRITER_H
+#define VECTGIF_AUDIOWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ring.h>
+
+/*
+ * Sound files
+ *
+ * The sound is written to one or more files of 16-bit PCM, either as a WAV file or raw little endian samples with
+ * no header. The frames are queued in a ring and written by a thread of the writer's own, so the emulation only
+ * waits if the disk falls behind by more than the whole ring. The WAV sizes are filled in when the file is closed.
+ *
+ * A frame has the samples of every file interleaved, channels samples for the first file, then the next, and so
+ * on. This keeps the stems of one frame together, they are split up on the writer thread.
+ */
+
+namespace vectaudio {
+
+enum format_t {
+    FORMAT_WAV,
+    FORMAT_RAW,
+};
+
+class AudioWriter
+{
+    struct output_t
+    {
+        FILE *file;
+        uint32_t data_bytes;
+    };
+
+    std::vector<output_t> outputs_;
+    format_t format_ = FORMAT_WAV;
+    unsigned channels_ = 1;
+    unsigned rate_ = 44100;
+    // samples in a frame, for all of the files
+    size_t frame_size_ = 0;
+
+    std::unique_ptr<vxl::spsc_ring<int16_t>> ring_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> done_{false};
+    std::atomic<bool> failed_{false};
+    // used by the writer thread
+    std::vector<int16_t> samples_;
+    std::vector<uint8_t> bytes_;
+
+    void run();
+    void drain();
+
+public:
+    // frames that can be queued before write waits for the writer thread
+    size_t buffer_frames = 1 << 18;
+
+    AudioWriter() = default;
+    AudioWriter(const AudioWriter&) = delete;
+    AudioWriter &operator=(const AudioWriter&) = delete;
+    ~AudioWriter();
+
+    // Create the files, each has channels channels at rate samples per second
+    bool open(const std::vector<std::string> &filenames, unsigned channels, unsigned rate, format_t format);
+    bool is_open() const;
+    // Queue count frames to be written
+    void write(const int16_t *frames, size_t count);
+    // Write the rest of the queued frames and close the files, returns false if any of the writes failed
+    bool close();
+};
+
+}
+
+#endif //VECTGIF_AUDIOWRITER_H
@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <algorithm>
 #include <memory>
 #include <array>
 #include <vector>
@@ -6,37 +7,202 @@
 #include <fstream>
 #include <string_view>
 #include <optional>
+#include <filesystem>
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 #include <vectrexia.h>
+#include <ppm.h>
 #include "gif.h"
+#include "vectrace.h"
+#include "audiowriter.h"
 #include <cxxopts.hpp>
 
 constexpr size_t ROM_SIZE = 65536;
 constexpr size_t MAX_FILENAME_SIZE = 2000;
 
-std::unique_ptr<Vectrex> vectrex = std::make_unique<Vectrex>();
-std::array<uint8_t, FRAME_WIDTH * FRAME_HEIGHT * 4> gif_buffer{};
+// static, the libretro core has a global of the same name
+static std::unique_ptr<Vectrex> vectrex = std::make_unique<Vectrex>();
+std::vector<uint8_t> gif_buffer{};
+vectaudio::AudioWriter audio{};
+// the colour overlay, if one was given, and its tint map at the output resolution
+vxgfx::dynamic_framebuffer<vxgfx::pf_argb_t> overlay_image{};
+vxgfx::tint_map overlay_tint{};
+
+// Convert the changed areas of the framebuffer to RGBA in gif_buffer
+template<typename Region>
+static void convert_frame(const VectorBuffer &framebuffer, const Region &region)
+{
+    auto width = framebuffer.width;
+    if (overlay_image.width > 0 && (overlay_tint.width != width || overlay_tint.height != framebuffer.height))
+        overlay_tint.build(overlay_image, width, framebuffer.height);
+    const bool tinted = overlay_tint.width == width;
+
+    for (const auto &r : region) {
+        for (int y = r.top; y < r.bottom; y++) {
+            auto fb = framebuffer.data() + y * width + r.left;
+            auto gb = gif_buffer.begin() + (y * width + r.left) * 4;
+            if (tinted) {
+                auto tint = overlay_tint.data() + y * width + r.left;
+                for (int x = r.left; x < r.right; x++, fb++, tint++) {
+                    auto q = static_cast<uint8_t>(fb->value * 0xffu);
+                    *gb++ = vxgfx::mul_c8(q, vxgfx::pf_argb_t::comp_r(*tint));
+                    *gb++ = vxgfx::mul_c8(q, vxgfx::pf_argb_t::comp_g(*tint));
+                    *gb++ = vxgfx::mul_c8(q, vxgfx::pf_argb_t::comp_b(*tint));
+                    *gb++ = q;
+                }
+                continue;
+            }
+            for (int x = r.left; x < r.right; x++, fb++) {
+                *gb++ = static_cast<uint8_t>(fb->value * 0xffu);
+                *gb++ = static_cast<uint8_t>(fb->value * 0xffu);
+                *gb++ = static_cast<uint8_t>(fb->value * 0xffu);
+                *gb++ = static_cast<uint8_t>(fb->value * 0xffu);
+            }
+        }
+    }
+}
+
+// Queue the sound rendered up to the current cycle, the mixed output first then the stems if they are enabled
+static void write_audio()
+{
+    static std::vector<int16_t> mixed(2048 * 2), stems(2048 * AY38910::STEM_COUNT), frames;
+    auto &psg = *vectrex->psg_;
+    psg.EndFrame(vectrex->cycles);
+
+    const bool with_stems = psg.StemsEnabled();
+    const size_t frame_size = with_stems ? 1 + AY38910::STEM_COUNT : 1;
+    while (auto count = psg.FillBuffer(mixed.data(), mixed.size() / 2))
+    {
+        if (with_stems)
+            psg.FillStems(stems.data(), count);
+        // the mixed output is the same in both channels, the files are mono
+        frames.resize(count * frame_size);
+        for (size_t i = 0; i < count; i++)
+        {
+            frames[i * frame_size] = mixed[i * 2];
+            for (size_t s = 1; s < frame_size; s++)
+                frames[i * frame_size + s] = stems[i * AY38910::STEM_COUNT + s - 1];
+        }
+        audio.write(frames.data(), count);
+    }
+}
+
+// Render count frames of a vector trace to a GIF, skipping skip frames before each one the same way as when the
+// GIF is made from the ROM
+static int replay_trace(const std::string &trace_filename, const std::string &giffilename, long skip, long count,
+                        int scale, int supersample, int decay_cycles, float scale_factor)
+{
+    vectrace::TraceReader reader;
+    if (!reader.open(trace_filename)) {
+        std::cerr << fmt::format("[TRACE]: Failed to open vector trace {}\n", trace_filename);
+        return 1;
+    }
+    std::cout << fmt::format("[TRACE]: replaying \"{}\", {} frames\n", trace_filename, reader.frame_count());
+
+    scale = std::clamp(scale, 1, MAX_OUTPUT_SCALE);
+    supersample = std::clamp(supersample, 1, MAX_RENDER_SCALE / scale);
+    vectrace::TraceRenderer renderer(scale, supersample);
+    renderer.decay_cycles = decay_cycles;
+    renderer.scale_factor = scale_factor;
+
+    // the first frame drawn is the one after the first skip frames
+    skip = std::max(skip, 0L);
+    const long first = skip;
+    if (!reader.seek(static_cast<uint32_t>(first), static_cast<uint64_t>(decay_cycles))) {
+        std::cerr << fmt::format("[TRACE]: frame {} is not in the trace\n", first);
+        return 1;
+    }
+
+    const auto full_frame = std::array<vxgfx::rect_t, 1>{vxgfx::rect_t{{0, 0}, {FRAME_WIDTH * scale, FRAME_HEIGHT * scale}}};
+    gif_buffer.resize(static_cast<size_t>(FRAME_WIDTH * scale) * FRAME_HEIGHT * scale * 4);
+    GifWriter gw{};
+    GifBegin(&gw, giffilename.c_str(), FRAME_WIDTH * scale, FRAME_HEIGHT * scale, 2, 8, false);
+
+    DisplayList segments;
+    uint32_t frame;
+    uint64_t cycle;
+    long written = 0;
+    while (written < count && reader.next(frame, cycle, segments)) {
+        renderer.add_frame(cycle, segments);
+        if (frame < first || (frame - first) % (skip + 1) != 0)
+            continue;
+        written++;
+
+        const auto &framebuffer = renderer.render();
+        convert_frame(framebuffer, full_frame);
+        GifWriteFrame(&gw, gif_buffer.data(), framebuffer.width, framebuffer.height, 2);
+        if (frame % 100 == 0) {
+            std::cout << fmt::format("[TRACE] frame = {}\n", frame);
+        }
+    }
+
+    GifEnd(&gw);
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
     long skipframes = 0;
     long outframes = 1000;
+    int scale = 1;
+    int supersample = 1;
+    int decay_cycles = 40000;
+    float scale_factor = 1.0f;
+    vectrace::TraceWriter trace;
     std::array<uint8_t, ROM_SIZE> rombuffer{};
     GifWriter gw{};
 
     // Parse command line arguments using cxxopts
     cxxopts::Options options("vectgif", "Generate a GIF from a Vectrex ROM");
     options.add_options()
-        ("s,skipframes", "Number of frames to skip", cxxopts::value<long>()->default_value("0"))
+        ("s,skipframes", "Frames to skip before each output frame", cxxopts::value<long>()->default_value("0"))
         ("n,outframes", "Number of output frames", cxxopts::value<long>()->default_value("1000"))
+        ("scale", "Output resolution multiplier (1-4)", cxxopts::value<int>()->default_value("1"))
+        ("supersample", "Supersampling factor", cxxopts::value<int>()->default_value("1"))
+        ("frame-sync", "End each frame when the game starts its next frame")
+        ("decay", "Beam decay time in cycles", cxxopts::value<int>()->default_value("40000"))
+        ("zoom", "Beam position scale factor", cxxopts::value<float>()->default_value("1.0"))
+        ("overlay", "Colour overlay image (binary PPM)", cxxopts::value<std::string>())
+        ("trace", "Write a vector trace to this file", cxxopts::value<std::string>()->default_value(""))
+        ("trace-raw", "Do not compress the vector trace")
+        ("replay", "Render the GIF from a vector trace instead of a ROM, close to a live render but not exact",
+                   cxxopts::value<std::string>())
         ("rom", "ROM file", cxxopts::value<std::string>())
-        ("gif", "GIF output file", cxxopts::value<std::string>()->default_value(""));
+        ("gif", "GIF output file", cxxopts::value<std::string>()->default_value(""))
+        ("audio", "Write the sound to this WAV file", cxxopts::value<std::string>()->default_value(""))
+        ("audio-raw", "Write raw 16-bit little endian PCM instead of WAV")
+        ("audio-stems", "Also write channels A, B, C, the noise and the DAC to separate files")
+        ("sample-rate", "Sound sample rate", cxxopts::value<unsigned>()->default_value("44100"));
 
     auto result = options.parse(argc, argv);
 
     skipframes = result["skipframes"].as<long>();
     outframes = result["outframes"].as<long>();
+    scale = result["scale"].as<int>();
+    supersample = result["supersample"].as<int>();
+    decay_cycles = std::max(result["decay"].as<int>(), 1);
+    scale_factor = result["zoom"].as<float>();
+
+    if (result.count("overlay")) {
+        auto overlay_filename = result["overlay"].as<std::string>();
+        if (!vxgfx::load_ppm(overlay_filename, overlay_image)) {
+            std::cerr << fmt::format("[OVERLAY]: Failed to load overlay {}\n", overlay_filename);
+            return 1;
+        }
+    }
+
+    if (result.count("replay")) {
+        if (!result["audio"].as<std::string>().empty()) {
+            std::cerr << "[AUDIO]: Vector traces do not have the sound, it can only be written from a ROM\n";
+            return 1;
+        }
+        std::string trace_filename = result["replay"].as<std::string>();
+        std::string giffilename = result["gif"].as<std::string>();
+        if (giffilename.empty())
+            giffilename = fmt::format("{}.gif", trace_filename);
+        return replay_trace(trace_filename, giffilename, skipframes, outframes, scale, supersample,
+                            decay_cycles, scale_factor);
+    }
 
     if (!result.count("rom")) {
         std::cerr << "vectgif: usage: vectgif <rom> [gif]\n";
@@ -70,34 +236,89 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    GifBegin(&gw, giffilename.c_str(), FRAME_WIDTH, FRAME_HEIGHT, 2, 8, false);
+    vectrex->SetResolution(scale, supersample);
+    vectrex->vector_buffer_.decay_cycles = decay_cycles;
+    vectrex->vector_buffer_.scale_factor = scale_factor;
+    auto width = vectrex->getFramebuffer()->width;
+    auto height = vectrex->getFramebuffer()->height;
+    gif_buffer.resize(static_cast<size_t>(width) * height * 4);
+
+    GifBegin(&gw, giffilename.c_str(), width, height, 2, 8, false);
+
+    if (result.count("trace") && !result["trace"].as<std::string>().empty()) {
+        auto trace_filename = result["trace"].as<std::string>();
+        if (!trace.open(trace_filename, !result.count("trace-raw"))) {
+            std::cerr << fmt::format("[TRACE]: Failed to create vector trace {}\n", trace_filename);
+            return 1;
+        }
+    }
 
     vectrex->Reset();
 
+    if (!result["audio"].as<std::string>().empty()) {
+        // the stems are named after the sound file, eg. sound_a.wav
+        const std::filesystem::path audio_filename = result["audio"].as<std::string>();
+        std::vector<std::string> filenames{ audio_filename.string() };
+        if (result.count("audio-stems")) {
+            for (auto suffix : { "a", "b", "c", "noise", "dac" }) {
+                auto stem = audio_filename;
+                stem.replace_filename(fmt::format("{}_{}{}", audio_filename.stem().string(), suffix,
+                                                  audio_filename.extension().string()));
+                filenames.push_back(stem.string());
+            }
+            vectrex->psg_->EnableStems(true);
+        }
+
+        const auto rate = std::clamp(result["sample-rate"].as<unsigned>(), 8000u, 192000u);
+        vectrex->psg_->SetSampleRate(rate);
+        const auto format = result.count("audio-raw") ? vectaudio::FORMAT_RAW : vectaudio::FORMAT_WAV;
+        if (!audio.open(filenames, 1, rate, format)) {
+            std::cerr << fmt::format("[AUDIO]: Failed to create sound file {}\n", audio_filename.string());
+            return 1;
+        }
+    }
+
     vectrex->SetPlayerOne(0x80, 0x80, 1, 1, 1, 1);
     vectrex->SetPlayerTwo(0x80, 0x80, 1, 1, 1, 1);
 
+    const bool frame_sync = result.count("frame-sync") > 0;
     for (int frame = 0; frame < outframes; frame++) {
         for (int s = 0; s < skipframes + 1; s++) {
-            vectrex->Run(30000);
+            // with frame sync, the fixed 30000 cycles is used until the game syncs
+            if (frame_sync)
+                vectrex->RunFrame(vectrex->FrameSynced() ? 60000 : 30000);
+            else
+                vectrex->Run(30000);
+
+            if (trace.is_open())
+                trace.add_frame(vectrex->cycles, vectrex->getDisplayList());
+            if (audio.is_open())
+                write_audio();
+            // skipped frames are not drawn, but the vectors still fade
+            if (s < skipframes)
+                vectrex->SkipFrame();
         }
 
         auto framebuffer = vectrex->getFramebuffer();
 
-        auto gb = gif_buffer.begin();
-        for (const auto &fb : *framebuffer) {
-            *gb++ = static_cast<uint8_t>(fb.value * 0xffu);
-            *gb++ = static_cast<uint8_t>(fb.value * 0xffu);
-            *gb++ = static_cast<uint8_t>(fb.value * 0xffu);
-            *gb++ = static_cast<uint8_t>(fb.value * 0xffu);
-        }
-        GifWriteFrame(&gw, gif_buffer.data(), FRAME_WIDTH, FRAME_HEIGHT, 2);
+        // only the areas that changed since the last frame need converting
+        convert_frame(*framebuffer, vectrex->getDirtyRegion());
+        GifWriteFrame(&gw, gif_buffer.data(), width, height, 2);
         if (frame % 100 == 0) {
             std::cout << fmt::format("[VECTREX] frame = {}\n", frame);
         }
     }
 
     GifEnd(&gw);
+    int status = 0;
+    if (trace.is_open() && !trace.close()) {
+        std::cerr << fmt::format("[TRACE]: Failed to write vector trace {}\n", result["trace"].as<std::string>());
+        status = 1;
+    }
+    if (!audio.close()) {
+        std::cerr << "[AUDIO]: Failed to write the sound file\n";
+        status = 1;
+    }
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,534 @@
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "vectrace.h"
+
+namespace vectrace {
+
+namespace {
+
+const char FILE_TAG[4] = {'V', 'X', 'T', 'R'};
+const char CHUNK_TAG[4] = {'C', 'H', 'N', 'K'};
+const size_t FILE_HEADER_SIZE = 12;
+const size_t CHUNK_HEADER_SIZE = 40;
+
+void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t) (v >> (i * 8));
+}
+
+void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t) (v >> (i * 8));
+}
+
+uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+uint64_t get_u64(const uint8_t *p)
+{
+    return (uint64_t) get_u32(p) | ((uint64_t) get_u32(p + 4) << 32);
+}
+
+int64_t to_units(float volts)
+{
+    return std::lround(volts * POSITION_PER_VOLT);
+}
+
+// LZ sequences are a token (high nibble literal length, low nibble match length - 4), the literals, and a 16 bit
+// match offset. Lengths of 15 are extended by bytes of 255 and a final byte < 255. The last sequence only has
+// literals.
+const size_t LZ_MIN_MATCH = 4;
+const int LZ_HASH_BITS = 12;
+
+void put_length(std::vector<uint8_t> &dst, size_t length)
+{
+    while (length >= 255)
+    {
+        dst.push_back(255);
+        length -= 255;
+    }
+    dst.push_back((uint8_t) length);
+}
+
+void put_sequence(std::vector<uint8_t> &dst, const uint8_t *literals, size_t literal_length,
+                  size_t offset, size_t match_length)
+{
+    const size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    dst.push_back((uint8_t) ((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15)));
+    if (literal_length >= 15)
+        put_length(dst, literal_length - 15);
+    dst.insert(dst.end(), literals, literals + literal_length);
+    if (match_length)
+    {
+        dst.push_back((uint8_t) offset);
+        dst.push_back((uint8_t) (offset >> 8));
+        if (match_code >= 15)
+            put_length(dst, match_code - 15);
+    }
+}
+
+bool get_length(const uint8_t *&src, const uint8_t *end, size_t &length)
+{
+    uint8_t b;
+    do
+    {
+        if (src == end)
+            return false;
+        b = *src++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+}
+
+void put_varint(std::vector<uint8_t> &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t) v);
+}
+
+void put_zigzag(std::vector<uint8_t> &out, int64_t v)
+{
+    put_varint(out, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+}
+
+bool get_varint(const std::vector<uint8_t> &in, size_t &pos, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7)
+    {
+        uint8_t b = in[pos++];
+        v |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool get_zigzag(const std::vector<uint8_t> &in, size_t &pos, int64_t &v)
+{
+    uint64_t u;
+    if (!get_varint(in, pos, u))
+        return false;
+    v = (int64_t) (u >> 1) ^ -(int64_t) (u & 1);
+    return true;
+}
+
+size_t lz_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst)
+{
+    std::array<int32_t, 1 << LZ_HASH_BITS> table;
+    table.fill(-1);
+    dst.clear();
+
+    size_t anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= size)
+    {
+        uint32_t word;
+        std::memcpy(&word, src + i, sizeof(word));
+        const uint32_t hash = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+        const int32_t candidate = table[hash];
+        table[hash] = (int32_t) i;
+
+        if (candidate >= 0 && i - candidate <= 0xffff && std::memcmp(src + candidate, src + i, LZ_MIN_MATCH) == 0)
+        {
+            size_t length = LZ_MIN_MATCH;
+            while (i + length < size && src[candidate + length] == src[i + length])
+                length++;
+            put_sequence(dst, src + anchor, i - anchor, i - candidate, length);
+            i += length;
+            anchor = i;
+        }
+        else
+        {
+            i++;
+        }
+
+        if (dst.size() >= size)
+            return 0;
+    }
+    put_sequence(dst, src + anchor, size - anchor, 0, 0);
+
+    return dst.size() < size ? dst.size() : 0;
+}
+
+bool lz_decompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size)
+{
+    const uint8_t *end = src + src_size;
+    size_t out = 0;
+
+    while (src < end)
+    {
+        const uint8_t token = *src++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !get_length(src, end, literal_length))
+            return false;
+        if (literal_length > (size_t) (end - src) || literal_length > size - out)
+            return false;
+        std::memcpy(dst + out, src, literal_length);
+        src += literal_length;
+        out += literal_length;
+
+        if (src == end)
+            break;
+
+        if (end - src < 2)
+            return false;
+        const size_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        size_t match_length = token & 0xf;
+        if (match_length == 15 && !get_length(src, end, match_length))
+            return false;
+        match_length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || match_length > size - out)
+            return false;
+        // the match can overlap the output, so copy a byte at a time
+        for (size_t n = 0; n < match_length; n++, out++)
+            dst[out] = dst[out - offset];
+    }
+    return out == size;
+}
+
+//<editor-fold desc="TraceWriter">
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool TraceWriter::open(const std::string &filename, bool compress)
+{
+    close();
+    file_ = std::fopen(filename.c_str(), "wb");
+    if (!file_)
+        return false;
+
+    compress_ = compress;
+    failed_ = false;
+    frames_ = chunk_first_frame_ = 0;
+    chunk_base_cycle_ = last_cycle_ = 0;
+    chunk_.clear();
+
+    uint8_t header[FILE_HEADER_SIZE] = {};
+    std::memcpy(header, FILE_TAG, sizeof(FILE_TAG));
+    put_u16(header + 4, VERSION);
+    put_u32(header + 8, POSITION_PER_VOLT);
+    return std::fwrite(header, sizeof(header), 1, file_) == 1;
+}
+
+bool TraceWriter::is_open() const
+{
+    return file_ != nullptr;
+}
+
+void TraceWriter::add_frame(uint64_t cycle, const DisplayList &segments)
+{
+    if (!file_)
+        return;
+
+    // the segments that started before the previous frame are already in the trace
+    auto is_new = [this](const vector_segment_t &s) { return s.start_cycle >= last_cycle_; };
+
+    put_varint(chunk_, cycle - last_cycle_);
+    put_varint(chunk_, (uint64_t) std::count_if(segments.begin(), segments.end(), is_new));
+
+    uint64_t prev_end = last_cycle_;
+    int64_t prev_x = 0, prev_y = 0, prev_intensity = 0;
+    for (const auto &s: segments)
+    {
+        if (!is_new(s))
+            continue;
+
+        const int64_t x0 = to_units(s.x0), y0 = to_units(s.y0);
+        const int64_t x1 = to_units(s.x1), y1 = to_units(s.y1);
+        const int64_t intensity = std::lround(s.intensity * 65536.0f);
+
+        put_zigzag(chunk_, (int64_t) (s.start_cycle - prev_end));
+        put_varint(chunk_, s.end_cycle - s.start_cycle);
+        put_zigzag(chunk_, x0 - prev_x);
+        put_zigzag(chunk_, y0 - prev_y);
+        put_zigzag(chunk_, x1 - x0);
+        put_zigzag(chunk_, y1 - y0);
+        put_zigzag(chunk_, intensity - prev_intensity);
+
+        prev_end = s.end_cycle;
+        prev_x = x1;
+        prev_y = y1;
+        prev_intensity = intensity;
+    }
+
+    last_cycle_ = cycle;
+    frames_++;
+
+    if (chunk_.size() >= chunk_bytes || frames_ - chunk_first_frame_ >= chunk_frames)
+        flush();
+}
+
+void TraceWriter::flush()
+{
+    if (!file_ || frames_ == chunk_first_frame_)
+        return;
+
+    codec_t codec = CODEC_RAW;
+    const uint8_t *payload = chunk_.data();
+    size_t stored_size = chunk_.size();
+    if (compress_)
+    {
+        size_t packed_size = lz_compress(chunk_.data(), chunk_.size(), packed_);
+        if (packed_size)
+        {
+            codec = CODEC_LZ;
+            payload = packed_.data();
+            stored_size = packed_size;
+        }
+    }
+
+    uint8_t header[CHUNK_HEADER_SIZE] = {};
+    std::memcpy(header, CHUNK_TAG, sizeof(CHUNK_TAG));
+    header[4] = codec;
+    put_u32(header + 8, (uint32_t) chunk_.size());
+    put_u32(header + 12, (uint32_t) stored_size);
+    put_u32(header + 16, chunk_first_frame_);
+    put_u32(header + 20, frames_ - chunk_first_frame_);
+    put_u64(header + 24, chunk_base_cycle_);
+    put_u64(header + 32, last_cycle_);
+    if (std::fwrite(header, sizeof(header), 1, file_) != 1 ||
+        std::fwrite(payload, 1, stored_size, file_) != stored_size)
+        failed_ = true;
+
+    chunk_.clear();
+    chunk_first_frame_ = frames_;
+    chunk_base_cycle_ = last_cycle_;
+}
+
+bool TraceWriter::close()
+{
+    if (!file_)
+        return !failed_;
+    flush();
+    if (std::fclose(file_) != 0)
+        failed_ = true;
+    file_ = nullptr;
+    return !failed_;
+}
+
+//</editor-fold>
+
+//<editor-fold desc="TraceReader">
+
+TraceReader::~TraceReader()
+{
+    if (file_)
+        std::fclose(file_);
+}
+
+bool TraceReader::open(const std::string &filename)
+{
+    if (file_)
+        std::fclose(file_);
+    chunks_.clear();
+    file_ = std::fopen(filename.c_str(), "rb");
+    if (!file_)
+        return false;
+
+    uint8_t header[FILE_HEADER_SIZE];
+    if (std::fread(header, sizeof(header), 1, file_) != 1 || std::memcmp(header, FILE_TAG, sizeof(FILE_TAG)) != 0
+        || (header[4] | (header[5] << 8)) != VERSION || get_u32(header + 8) != (uint32_t) POSITION_PER_VOLT)
+        return false;
+
+    // index the chunks, so that any frame can be found without decoding the ones before it
+    uint8_t chunk_header[CHUNK_HEADER_SIZE];
+    while (std::fread(chunk_header, sizeof(chunk_header), 1, file_) == 1)
+    {
+        if (std::memcmp(chunk_header, CHUNK_TAG, sizeof(CHUNK_TAG)) != 0)
+            return false;
+        chunk_info_t info{};
+        info.offset = std::ftell(file_);
+        info.codec = chunk_header[4];
+        info.raw_size = get_u32(chunk_header + 8);
+        info.stored_size = get_u32(chunk_header + 12);
+        info.first_frame = get_u32(chunk_header + 16);
+        info.frame_count = get_u32(chunk_header + 20);
+        info.base_cycle = get_u64(chunk_header + 24);
+        info.last_cycle = get_u64(chunk_header + 32);
+        chunks_.push_back(info);
+        if (std::fseek(file_, info.stored_size, SEEK_CUR) != 0)
+            return false;
+    }
+
+    return seek(0, 0);
+}
+
+uint32_t TraceReader::frame_count() const
+{
+    return chunks_.empty() ? 0 : chunks_.back().first_frame + chunks_.back().frame_count;
+}
+
+bool TraceReader::seek(uint32_t frame, uint64_t history)
+{
+    auto chunk = std::find_if(chunks_.begin(), chunks_.end(), [frame](const chunk_info_t &c) {
+        return frame < c.first_frame + c.frame_count;
+    });
+    if (chunk == chunks_.end())
+        return false;
+
+    // go back to the first chunk with frames in the history before this chunk
+    const uint64_t start = chunk->base_cycle > history ? chunk->base_cycle - history : 0;
+    while (chunk != chunks_.begin() && (chunk - 1)->last_cycle > start)
+        chunk--;
+
+    next_chunk_ = (size_t) (chunk - chunks_.begin());
+    frame_ = chunk_end_frame_ = 0;
+    return true;
+}
+
+bool TraceReader::load_chunk(size_t index)
+{
+    const auto &info = chunks_[index];
+    if (std::fseek(file_, info.offset, SEEK_SET) != 0)
+        return false;
+
+    payload_.resize(info.raw_size);
+    if (info.codec == CODEC_LZ)
+    {
+        packed_.resize(info.stored_size);
+        if (std::fread(packed_.data(), 1, packed_.size(), file_) != packed_.size() ||
+            !lz_decompress(packed_.data(), packed_.size(), payload_.data(), payload_.size()))
+            return false;
+    }
+    else if (info.codec == CODEC_RAW)
+    {
+        if (std::fread(payload_.data(), 1, payload_.size(), file_) != payload_.size())
+            return false;
+    }
+    else
+    {
+        return false;
+    }
+
+    pos_ = 0;
+    frame_ = info.first_frame;
+    chunk_end_frame_ = info.first_frame + info.frame_count;
+    cycle_ = info.base_cycle;
+    return true;
+}
+
+bool TraceReader::next(uint32_t &frame, uint64_t &cycle, DisplayList &segments)
+{
+    if (frame_ == chunk_end_frame_)
+    {
+        if (next_chunk_ >= chunks_.size() || !load_chunk(next_chunk_++))
+            return false;
+    }
+
+    uint64_t delta, count;
+    if (!get_varint(payload_, pos_, delta) || !get_varint(payload_, pos_, count))
+        return false;
+
+    segments.clear();
+    uint64_t prev_end = cycle_;
+    int64_t prev_x = 0, prev_y = 0, prev_intensity = 0;
+    for (uint64_t n = 0; n < count; n++)
+    {
+        int64_t start, x0, y0, dx, dy, intensity;
+        uint64_t length;
+        if (!get_zigzag(payload_, pos_, start) || !get_varint(payload_, pos_, length) ||
+            !get_zigzag(payload_, pos_, x0) || !get_zigzag(payload_, pos_, y0) ||
+            !get_zigzag(payload_, pos_, dx) || !get_zigzag(payload_, pos_, dy) ||
+            !get_zigzag(payload_, pos_, intensity))
+            return false;
+
+        vector_segment_t s{};
+        s.start_cycle = prev_end + start;
+        s.end_cycle = s.start_cycle + length;
+        x0 += prev_x;
+        y0 += prev_y;
+        intensity += prev_intensity;
+        s.x0 = (float) x0 / POSITION_PER_VOLT;
+        s.y0 = (float) y0 / POSITION_PER_VOLT;
+        s.x1 = (float) (x0 + dx) / POSITION_PER_VOLT;
+        s.y1 = (float) (y0 + dy) / POSITION_PER_VOLT;
+        s.intensity = intensity / 65536.0f;
+        segments.push_back(s);
+
+        prev_end = s.end_cycle;
+        prev_x = x0 + dx;
+        prev_y = y0 + dy;
+        prev_intensity = intensity;
+    }
+
+    cycle_ += delta;
+    frame = frame_++;
+    cycle = cycle_;
+    return true;
+}
+
+//</editor-fold>
+
+//<editor-fold desc="TraceRenderer">
+
+TraceRenderer::TraceRenderer(int scale, int supersample) :
+    buffer_(FRAME_WIDTH * scale, FRAME_HEIGHT * scale),
+    render_buffer_(supersample > 1 ? FRAME_WIDTH * scale * supersample : 0,
+                   supersample > 1 ? FRAME_HEIGHT * scale * supersample : 0),
+    supersample_(supersample)
+{
+}
+
+void TraceRenderer::add_frame(uint64_t cycle, const DisplayList &segments)
+{
+    prev_cycle_ = cycle_;
+    cycle_ = cycle;
+
+    // segments are drawn with the intensity they had at the end of the previous frame
+    const uint64_t faded_at = prev_cycle_;
+    const float decay = 1.0f / decay_cycles;
+    live_.erase(std::remove_if(live_.begin(), live_.end(), [faded_at, decay](const vector_segment_t &s) {
+        return faded_at > s.start_cycle && s.intensity - (faded_at - s.start_cycle) * decay <= 0.0f;
+    }), live_.end());
+    live_.insert(live_.end(), segments.begin(), segments.end());
+}
+
+const VectorBuffer &TraceRenderer::render()
+{
+    auto &target = (supersample_ > 1) ? render_buffer_ : buffer_;
+    target.clear();
+
+    const float decay = 1.0f / decay_cycles;
+    for (const auto &s: live_)
+    {
+        float intensity = s.intensity;
+        if (prev_cycle_ > s.start_cycle)
+            intensity -= (prev_cycle_ - s.start_cycle) * decay;
+
+        auto p0 = vp_.translate(s.x0 * scale_factor, s.y0 * scale_factor, target.width, target.height);
+        auto p1 = vp_.translate(s.x1 * scale_factor, s.y1 * scale_factor, target.width, target.height);
+        vxgfx::draw_line<vxgfx::m_direct>(target, p0.first, p0.second, p1.first, p1.second,
+                                          vxgfx::pf_mono_t{ intensity });
+    }
+
+    if (supersample_ > 1)
+        vxgfx::downsample_box(buffer_, render_buffer_, supersample_);
+
+    return buffer_;
+}
+
+//</editor-fold>
+
+}
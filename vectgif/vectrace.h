@@ -0,0 +1,151 @@
+#ifndef VECTGIF_VECTRACE_H
+#define VECTGIF_VECTRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <vectorizer.h>
+
+/*
+ * Vector trace files
+ *
+ * A trace is a log of the beam segments drawn in each frame, it can be re-rendered at any resolution or with
+ * different decay/scale settings without emulating the ROM again. Only the segments drawn in a frame are
+ * recorded, the fading of older segments is done by the renderer.
+ *
+ * File layout, all integers are little endian:
+ *   header: "VXTR", u16 version, u16 reserved, u32 position units per volt
+ *   chunks: "CHNK", u8 codec, u8[3] reserved, u32 raw size, u32 stored size, u32 first frame, u32 frame count,
+ *           u64 base cycle (the cycle of the frame before the chunk), u64 last cycle, payload
+ *
+ * The payload is a sequence of frames, each frame is:
+ *   varint cycles since the previous frame, varint segment count, then for each segment
+ *   zigzag start cycle - previous segment end cycle, varint end cycle - start cycle,
+ *   zigzag x0 - previous x1, zigzag y0 - previous y1, zigzag x1 - x0, zigzag y1 - y0,
+ *   zigzag intensity - previous intensity
+ *
+ * Every chunk can be decoded on its own, the payload is stored as is or compressed with lz_compress.
+ *
+ * A replay is close to the live render but not pixel identical: the positions are rounded to 1/POSITION_PER_VOLT V
+ * and the TraceRenderer fades the segments in floating point, where the Vectorizer keeps the beam in its fixed point
+ * units. Line ends can land a pixel apart and intensities can differ in the last bits. Golden frames should be
+ * compared against live renders, the trace is for looking at and re-rendering the vectors.
+ */
+
+namespace vectrace {
+
+const uint16_t VERSION = 1;
+const int32_t POSITION_PER_VOLT = 8192;
+
+enum codec_t : uint8_t {
+    CODEC_RAW = 0,
+    CODEC_LZ  = 1,
+};
+
+// Variable length integers, 7 bits a byte with the top bit set on all but the last byte. Signed values are zigzag
+// encoded first, so that small negative values are short too. The getters return false at the end of the input.
+void put_varint(std::vector<uint8_t> &out, uint64_t v);
+void put_zigzag(std::vector<uint8_t> &out, int64_t v);
+bool get_varint(const std::vector<uint8_t> &in, size_t &pos, uint64_t &v);
+bool get_zigzag(const std::vector<uint8_t> &in, size_t &pos, int64_t &v);
+
+// Compress src with a small LZ77 codec, returns the compressed size or 0 if the data does not compress
+size_t lz_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst);
+// Decompress exactly size bytes in to dst, returns false if the input is corrupt
+bool lz_decompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size);
+
+class TraceWriter
+{
+    FILE *file_ = nullptr;
+    bool compress_ = true;
+    // a chunk or the end of the file could not be written, the trace is truncated
+    bool failed_ = false;
+    std::vector<uint8_t> chunk_;
+    std::vector<uint8_t> packed_;
+    uint32_t frames_ = 0;
+    uint32_t chunk_first_frame_ = 0;
+    uint64_t chunk_base_cycle_ = 0;
+    uint64_t last_cycle_ = 0;
+
+    void flush();
+
+public:
+    // frames are grouped in to chunks of up to this many bytes or frames
+    size_t chunk_bytes = 64 * 1024;
+    uint32_t chunk_frames = 64;
+
+    TraceWriter() = default;
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter &operator=(const TraceWriter&) = delete;
+    ~TraceWriter();
+
+    bool open(const std::string &filename, bool compress);
+    bool is_open() const;
+    // Add a frame that ended at cycle, only the segments that started after the previous frame are written
+    void add_frame(uint64_t cycle, const DisplayList &segments);
+    // Write the last chunk and close the file, returns false if any of the writes failed
+    bool close();
+};
+
+class TraceReader
+{
+    struct chunk_info_t
+    {
+        long offset;
+        uint8_t codec;
+        uint32_t raw_size, stored_size;
+        uint32_t first_frame, frame_count;
+        uint64_t base_cycle, last_cycle;
+    };
+
+    FILE *file_ = nullptr;
+    std::vector<chunk_info_t> chunks_;
+    size_t next_chunk_ = 0;
+    std::vector<uint8_t> payload_;
+    std::vector<uint8_t> packed_;
+    size_t pos_ = 0;
+    uint32_t frame_ = 0, chunk_end_frame_ = 0;
+    uint64_t cycle_ = 0;
+
+    bool load_chunk(size_t index);
+
+public:
+    TraceReader() = default;
+    TraceReader(const TraceReader&) = delete;
+    TraceReader &operator=(const TraceReader&) = delete;
+    ~TraceReader();
+
+    bool open(const std::string &filename);
+    uint32_t frame_count() const;
+    // Position the reader so that the frames needed to draw frame (ie. the ones drawn in the history cycles
+    // before it) are read next
+    bool seek(uint32_t frame, uint64_t history);
+    // Read the next frame, returns false at the end of the trace or if it is corrupt
+    bool next(uint32_t &frame, uint64_t &cycle, DisplayList &segments);
+};
+
+// Draws the segments from a trace, fading them the same way as the Vectorizer
+class TraceRenderer
+{
+    DisplayList live_;
+    VectorBuffer buffer_;
+    VectorBuffer render_buffer_;
+    int supersample_;
+    uint64_t cycle_ = 0, prev_cycle_ = 0;
+    vxgfx::viewport vp_;
+
+public:
+    int decay_cycles = 40000;
+    float scale_factor = 1.0f;
+
+    TraceRenderer(int scale, int supersample);
+
+    // Add the segments drawn in the frame that ended at cycle
+    void add_frame(uint64_t cycle, const DisplayList &segments);
+    const VectorBuffer &render();
+};
+
+}
+
+#endif //VECTGIF_VECTRACE_H